@@ -0,0 +1,391 @@
+#include "stdafx.h"
+#include "corpus.h"
+
+#include <CommandLine.h>
+#include <bspfile.h>
+#include <versions.h>
+#include <rmem.h>
+#include <arena.h>
+#include <threadpool.h>
+#include <outputset.h>
+#include <entity_partition.h>
+#include <stltools.h>
+#include <nativefile.h>
+#include <functional>
+
+// a benchmark runs at least this many timed iterations
+#define BENCH_MIN_ITERATIONS 3
+#define BENCH_MAX_ITERATIONS 1000
+
+// sizes of the buffers the in-memory benchmarks work on, at scale 1
+#define BENCH_LIGHTPROBES_SIZE (8 << 20)
+#define BENCH_ENTITY_PARTITION_SIZE (4 << 20)
+#define BENCH_BASE64_SIZE (16 << 20)
+
+struct BenchOptions_t
+{
+	double scale; // of the corpus and buffers, see SyntheticMapDesc_t
+	int64_t minTimeNs; // a benchmark runs until it has taken at least this long
+	std::string filter; // only run benchmarks whose name contains this
+};
+
+struct BenchResult_t
+{
+	std::string name;
+	size_t numBytes;
+	size_t numIterations;
+	double medianMs;
+	double bestMs;
+	double throughput; // MB/s over the median
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: something to measure; setup and teardown run around every
+//			iteration and aren't timed, either may be empty
+//-----------------------------------------------------------------------------
+struct Benchmark_t
+{
+	std::string name;
+	size_t numBytes; // processed by one iteration
+	std::function<void()> setup;
+	std::function<void()> run;
+	std::function<void()> teardown;
+};
+
+static bool RunBenchmark(const Benchmark_t& bench, const BenchOptions_t& options, std::vector<BenchResult_t>& results)
+{
+	if (!options.filter.empty() && bench.name.find(options.filter) == std::string::npos)
+		return false;
+
+	std::vector<int64_t> times;
+	int64_t totalTime = 0;
+
+	// the first iteration warms up the caches and isn't counted
+	for (size_t i = 0; i <= BENCH_MIN_ITERATIONS || (totalTime < options.minTimeNs && i <= BENCH_MAX_ITERATIONS); i++)
+	{
+		if (bench.setup)
+			bench.setup();
+
+		const int64_t start = CScopeTimer::GetTime();
+		bench.run();
+		const int64_t time = CScopeTimer::GetTime() - start;
+
+		if (bench.teardown)
+			bench.teardown();
+
+		if (i)
+		{
+			times.push_back(time);
+			totalTime += time;
+		}
+	}
+
+	std::sort(times.begin(), times.end());
+
+	BenchResult_t result;
+	result.name = bench.name;
+	result.numBytes = bench.numBytes;
+	result.numIterations = times.size();
+	result.medianMs = times[times.size() / 2] / 1e6;
+	result.bestMs = times[0] / 1e6;
+	result.throughput = result.medianMs > 0.0 ? (bench.numBytes / 1e6) / (result.medianMs / 1e3) : 0.0;
+
+	printf("%-40s %9.2f MiB %6zu %11.3f ms %11.3f ms %10.1f MB/s\n", result.name.c_str(), result.numBytes / double(1 << 20),
+		result.numIterations, result.medianMs, result.bestMs, result.throughput);
+
+	results.push_back(result);
+	return true;
+}
+
+static bool WriteResults(const std::string& filePath, const BenchOptions_t& options, const std::vector<BenchResult_t>& results)
+{
+	std::string json = Format("{\n  \"scale\":%g,\n  \"results\": [", options.scale);
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult_t& result = results[i];
+
+		json += i ? ",\n    {\"name\":" : "\n    {\"name\":";
+		AppendJsonString(json, result.name);
+		json += Format(",\"bytes\":%zu,\"iterations\":%zu,\"medianMs\":%.3f,\"bestMs\":%.3f,\"MBps\":%.1f}",
+			result.numBytes, result.numIterations, result.medianMs, result.bestMs, result.throughput);
+	}
+
+	json += "\n  ]\n}\n";
+
+	CNativeFile out;
+	if (!out.Open(filePath, CNativeFile::WRITE) || !out.Write(json.data(), json.size()))
+	{
+		printf("Failed to write results to \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	printf("Wrote results to \"%s\"\n", filePath.c_str());
+	return true;
+}
+
+// converts each synthetic map as the tool does, with its output discarded
+static void RunConvertBenchmarks(const std::string& corpusDir, const BenchOptions_t& options, std::vector<BenchResult_t>& results)
+{
+	for (int version = 47; version <= 51; version++)
+	{
+		SyntheticMapDesc_t desc;
+		desc.name = Format("mp_bench_v%d.bsp", version);
+		desc.version = version;
+		desc.scale = options.scale;
+		desc.seed = uint64_t(version);
+
+		std::string bspPath;
+		size_t totalSize;
+
+		if (!GenerateSyntheticMap(corpusDir, desc, bspPath, totalSize))
+			Error("Failed to generate synthetic map \"%s\"\n", desc.name.c_str());
+
+		BSPHeader_t header;
+		CNativeFile bspIn;
+
+		if (!bspIn.Open(bspPath, CNativeFile::READ) || bspIn.Read(&header, sizeof(header)) != sizeof(header))
+			Error("Failed to read \"%s\"\n", bspPath.c_str());
+
+		for (const bool packAllLumps : { false, true })
+		{
+			ConvertOptions_t convertOptions;
+			convertOptions.packAllLumps = packAllLumps;
+
+			// ConvertBSP patches the header in place
+			BSPHeader_t headerCopy;
+			COutputSet outputs;
+			std::string output;
+
+			Benchmark_t bench;
+			bench.name = Format("ConvertBSP v%d %s", version, packAllLumps ? "packed" : "unpacked");
+			bench.numBytes = totalSize;
+			bench.setup = [&]() { headerCopy = header; };
+			bench.run = [&]()
+			{
+				CScopedMsgBuffer msgBuffer(&output);
+				ConvertBSP(bspPath, reinterpret_cast<char*>(&headerCopy), convertOptions, outputs);
+			};
+			bench.teardown = [&]()
+			{
+				if (outputs.IsEmpty())
+					Error("ConvertBSP didn't write anything for \"%s\"\n", bspPath.c_str());
+
+				outputs.Discard();
+				output.clear();
+			};
+
+			RunBenchmark(bench, options, results);
+		}
+	}
+}
+
+static void RunLightProbeBenchmarks(const BenchOptions_t& options, std::vector<BenchResult_t>& results)
+{
+	CCorpusRandom random(101);
+	std::vector<char> lightProbes;
+	GenerateLightProbes_v51(random, size_t(BENCH_LIGHTPROBES_SIZE * options.scale) / sizeof(r5::v51::dlightprobe_t) + 1, lightProbes);
+
+	CArena arena;
+
+	Benchmark_t bench;
+	bench.name = "ConvertLightProbes_v51";
+	bench.numBytes = lightProbes.size();
+	bench.run = [&]()
+	{
+		rmem lumpBuf(lightProbes.data());
+		char* lumpData = lightProbes.data();
+		size_t lumpSize = lightProbes.size();
+
+		ConvertLightProbes_v51(lumpBuf, lumpData, lumpSize, arena);
+	};
+	bench.teardown = [&]() { arena.Reset(); };
+
+	RunBenchmark(bench, options, results);
+}
+
+static void RunEntityPartitionBenchmarks(const BenchOptions_t& options, std::vector<BenchResult_t>& results)
+{
+	CCorpusRandom random(102);
+	std::string partition;
+	const size_t numObjects = std::max(size_t(1), size_t(BENCH_ENTITY_PARTITION_SIZE * options.scale / 300));
+	GenerateEntityPartition(random, numObjects, int(numObjects / 3 + 1), partition);
+
+	// the benchmarks of the later phases run the earlier ones untimed
+	std::unique_ptr<CEntityPartitionMgr> pMgr;
+	std::string output;
+
+	const auto parse = [&]()
+	{
+		if (!pMgr->ParseFromBuffer(partition.data(), true))
+			Error("Failed to parse the synthetic entity partition\n");
+	};
+	const auto convert = [&]()
+	{
+		if (!pMgr->ConvertEntityPartition())
+			Error("Failed to convert the synthetic entity partition\n");
+	};
+	const auto write = [&]()
+	{
+		output.clear();
+		pMgr->WriteToString(output);
+	};
+
+	Benchmark_t bench;
+	bench.numBytes = partition.size();
+	bench.teardown = [&]() { pMgr.reset(); };
+
+	bench.name = "CEntityPartitionMgr parse";
+	bench.setup = [&]() { pMgr.reset(new CEntityPartitionMgr); };
+	bench.run = parse;
+	RunBenchmark(bench, options, results);
+
+	bench.name = "CEntityPartitionMgr convert";
+	bench.setup = [&]() { pMgr.reset(new CEntityPartitionMgr); parse(); };
+	bench.run = convert;
+	RunBenchmark(bench, options, results);
+
+	bench.name = "CEntityPartitionMgr write";
+	bench.setup = [&]() { pMgr.reset(new CEntityPartitionMgr); parse(); convert(); };
+	bench.run = write;
+	RunBenchmark(bench, options, results);
+
+	// what the tool actually runs, all three phases in a single pass
+	bench.name = "CEntityPartitionStream";
+	bench.setup = nullptr;
+	bench.teardown = nullptr;
+	bench.run = [&]()
+	{
+		CEntityPartitionStream stream(true);
+		output.clear();
+
+		if (!stream.Process(partition.data(), partition.size(), output) || !stream.Finish(output))
+			Error("Failed to stream the synthetic entity partition\n");
+	};
+	RunBenchmark(bench, options, results);
+}
+
+static void RunBase64Benchmarks(const BenchOptions_t& options, std::vector<BenchResult_t>& results)
+{
+	CCorpusRandom random(103);
+	std::vector<char> data(std::max(size_t(3), size_t(BENCH_BASE64_SIZE * options.scale) / 3 * 3));
+	random.Fill(data.data(), data.size());
+
+	std::vector<char> encoded(Base64EncodedSize(data.size()));
+	Base64Encode(data.data(), data.size(), encoded.data());
+
+	std::vector<unsigned char> decoded(Base64DecodedSizeMax(encoded.size()));
+
+	Benchmark_t bench;
+	bench.name = "Base64Encode";
+	bench.numBytes = data.size();
+	bench.run = [&]() { Base64Encode(data.data(), data.size(), encoded.data()); };
+	RunBenchmark(bench, options, results);
+
+	bench.name = "Base64Decode";
+	bench.numBytes = encoded.size();
+	bench.run = [&]()
+	{
+		if (Base64Decode(encoded.data(), encoded.size(), decoded.data()) != data.size())
+			Error("Base64 round trip lost data\n");
+	};
+	RunBenchmark(bench, options, results);
+}
+
+int main(int argc, char** argv)
+{
+	printf("bspconv_bench - Copyright (c) %s, rexx\n", &__DATE__[7]);
+
+	const CommandLine cmdline(argc, argv);
+
+	if (cmdline.HasParam("-help"))
+	{
+		printf("\nUsage: bspconv_bench [-quick] [-scale F] [-mintime ms] [-filter text] [-dir path] [-keep] [-generate] [-json out.json]\n");
+		printf("\n");
+		printf("Options:\n");
+		printf("  -quick       Small corpus and a single round of iterations, to check that everything runs\n");
+		printf("  -scale F     Size of the synthetic maps and buffers relative to a mid-sized map (default 0.5)\n");
+		printf("  -mintime ms  Keep iterating a benchmark until it has taken this long (default 1000)\n");
+		printf("  -filter text Only run the benchmarks whose name contains text\n");
+		printf("  -dir path    Where the synthetic corpus is generated and kept (default: a temporary directory)\n");
+		printf("  -keep        Keep the synthetic corpus in the temporary directory\n");
+		printf("  -generate    Only generate the synthetic corpus (implies -keep)\n");
+		printf("  -json FILE   Also write the results as JSON\n");
+		return 0;
+	}
+
+	const bool quick = cmdline.HasParam("-quick");
+
+	BenchOptions_t options;
+	options.scale = atof(cmdline.GetParamValue("-scale", quick ? "0.03" : "0.5"));
+	options.minTimeNs = int64_t(std::max(0, atoi(cmdline.GetParamValue("-mintime", quick ? "0" : "1000")))) * 1000000;
+	options.filter = cmdline.GetParamValue("-filter", "");
+
+	if (options.scale <= 0.0)
+		Error("-scale has to be larger than 0\n");
+
+	const bool generateOnly = cmdline.HasParam("-generate");
+	const bool keepCorpus = generateOnly || cmdline.HasParam("-keep");
+
+	// a directory that has been passed in is never removed
+	std::string corpusDir = cmdline.GetParamValue("-dir", "");
+	const bool isTempDir = corpusDir.empty();
+
+	if (isTempDir)
+		corpusDir = (fs::temp_directory_path() / Format("bspconv_bench_%llx", (unsigned long long)CScopeTimer::GetTime())).string();
+
+	std::error_code ec;
+	fs::create_directories(corpusDir, ec);
+
+	if (ec)
+		Error("Failed to create corpus directory \"%s\"\n", corpusDir.c_str());
+
+	printf("Synthetic corpus: %s (scale %g)\n", corpusDir.c_str(), options.scale);
+
+	// the converter runs its lumps and entity partitions on the pool, as in
+	// single file mode
+	CThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	g_pThreadPool = &pool;
+
+	std::vector<BenchResult_t> results;
+
+	if (generateOnly)
+	{
+		for (int version = 47; version <= 51; version++)
+		{
+			SyntheticMapDesc_t desc;
+			desc.name = Format("mp_bench_v%d.bsp", version);
+			desc.version = version;
+			desc.scale = options.scale;
+			desc.seed = uint64_t(version);
+
+			std::string bspPath;
+			size_t totalSize;
+
+			if (!GenerateSyntheticMap(corpusDir, desc, bspPath, totalSize))
+				Error("Failed to generate synthetic map \"%s\"\n", desc.name.c_str());
+
+			printf("Generated %s (%.2f MiB)\n", bspPath.c_str(), totalSize / double(1 << 20));
+		}
+	}
+	else
+	{
+		printf("\n%-40s %13s %6s %14s %14s %15s\n", "benchmark", "size", "iters", "median", "best", "throughput");
+
+		RunConvertBenchmarks(corpusDir, options, results);
+		RunLightProbeBenchmarks(options, results);
+		RunEntityPartitionBenchmarks(options, results);
+		RunBase64Benchmarks(options, results);
+	}
+
+	g_pThreadPool = nullptr;
+
+	if (isTempDir && !keepCorpus)
+		fs::remove_all(corpusDir, ec);
+
+	const std::string jsonPath = cmdline.GetParamValue("-json", "");
+	if (!jsonPath.empty() && !WriteResults(jsonPath, options, results))
+		return 1;
+
+	return 0;
+}
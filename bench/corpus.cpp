@@ -0,0 +1,365 @@
+#include "stdafx.h"
+#include "corpus.h"
+
+#include "bspfile.h"
+#include "nativefile.h"
+#include "stltools.h"
+
+// size of the pieces brush models are split into, see CEntityPartitionMgr
+#define COLL_CHUNK_SIZE 0x78
+
+// entity text of a map at scale 1, spread over the entities lump and the
+// entity partitions; objects are about 300 bytes on average
+#define ENTITY_TEXT_SIZE (2 << 20)
+#define AVERAGE_ENTITY_SIZE 300
+
+// share of the entity text in the entities lump, the partitions have the rest
+#define ENTITIES_LUMP_SHARE 0.2
+
+// lump sizes of a mid-sized map (scale 1), the lumps not listed are absent;
+// the entities, entity partitions, game lump and lightprobes are generated
+// with their real layout (sized separately for the first two), all others
+// are random bytes
+static const struct LumpSize_t
+{
+	int index;
+	size_t size;
+} s_lumpSizes[] =
+{
+	{ LUMP_ENTITIES,                      0 },
+	{ LUMP_PLANES,                        256 << 10 },
+	{ LUMP_TEXDATA,                       16 << 10 },
+	{ LUMP_VERTEXES,                      2 << 20 },
+	{ LUMP_LIGHTPROBE_PARENT_INFOS,       8 << 10 },
+	{ LUMP_SHADOW_ENVIRONMENTS,           256 },
+	{ LUMP_MODELS,                        4 << 10 },
+	{ LUMP_TEXDATA_STRING_DATA,           32 << 10 },
+	{ LUMP_CONTENTS_MASKS,                1 << 10 },
+	{ LUMP_SURFACE_PROPERTIES,            8 << 10 },
+	{ LUMP_BVH_NODES,                     6 << 20 },
+	{ LUMP_BVH_LEAF_DATA,                 3 << 20 },
+	{ LUMP_PACKED_VERTICES,               2 << 20 },
+	{ LUMP_ENTITY_PARTITIONS,             0 },
+	{ LUMP_VERTNORMALS,                   3 << 20 },
+	{ LUMP_GAME_LUMP,                     512 << 10 },
+	{ LUMP_PAKFILE,                       1 << 20 },
+	{ LUMP_CUBEMAPS,                      4 << 10 },
+	{ LUMP_WORLD_LIGHTS,                  64 << 10 },
+	{ LUMP_WORLD_LIGHT_PARENT_INFOS,      4 << 10 },
+	{ LUMP_VERTS_UNLIT,                   512 << 10 },
+	{ LUMP_VERTS_LIT_FLAT,                256 << 10 },
+	{ LUMP_VERTS_LIT_BUMP,                4 << 20 },
+	{ LUMP_VERTS_UNLIT_TS,                512 << 10 },
+	{ LUMP_MESH_INDICES,                  3 << 20 },
+	{ LUMP_MESHES,                        256 << 10 },
+	{ LUMP_MESH_BOUNDS,                   128 << 10 },
+	{ LUMP_MATERIAL_SORT,                 64 << 10 },
+	{ LUMP_LIGHTMAP_HEADERS,              1 << 10 },
+	{ LUMP_TWEAK_LIGHTS,                  4 << 10 },
+	{ LUMP_LIGHTMAP_DATA_SKY,             4 << 20 },
+	{ LUMP_CSM_AABB_NODES,                512 << 10 },
+	{ LUMP_CSM_OBJ_REFS,                  64 << 10 },
+	{ LUMP_LIGHTPROBES,                   8 << 20 },
+	{ LUMP_STATIC_PROP_LIGHTPROBE_INDEX,  32 << 10 },
+	{ LUMP_LIGHTPROBETREE,                512 << 10 },
+	{ LUMP_LIGHTPROBEREFS,                256 << 10 },
+	{ LUMP_LIGHTMAP_DATA_REAL_TIME_LIGHTS, 8 << 20 },
+	{ LUMP_CELL_BSP_NODES,                64 << 10 },
+	{ LUMP_CELLS,                         32 << 10 },
+	{ LUMP_PORTALS,                       64 << 10 },
+	{ LUMP_PORTAL_VERTS,                  64 << 10 },
+	{ LUMP_PORTAL_EDGES,                  32 << 10 },
+	{ LUMP_PORTAL_VERT_EDGES,             64 << 10 },
+	{ LUMP_PORTAL_VERT_REFS,              32 << 10 },
+	{ LUMP_PORTAL_EDGE_REFS,              32 << 10 },
+	{ LUMP_PORTAL_EDGE_ISECT_EDGE,        16 << 10 },
+	{ LUMP_PORTAL_EDGE_ISECT_AT_VERT,     16 << 10 },
+	{ LUMP_PORTAL_EDGE_ISECT_HEADER,      16 << 10 },
+	{ LUMP_OCCLUSIONMESH_VERTS,           256 << 10 },
+	{ LUMP_OCCLUSIONMESH_INDICES,         128 << 10 },
+	{ LUMP_CELL_AABB_NODES,               256 << 10 },
+	{ LUMP_OBJ_REFS,                      128 << 10 },
+	{ LUMP_OBJ_REF_BOUNDS,                256 << 10 },
+	{ LUMP_LIGHTMAP_DATA_RTL_PAGE,        2 << 20 },
+	{ LUMP_LEVEL_INFO,                    32 },
+	{ LUMP_SHADOW_MESH_OPAQUE_VERTS,      512 << 10 },
+	{ LUMP_SHADOW_MESH_ALPHA_VERTS,       64 << 10 },
+	{ LUMP_SHADOW_MESH_INDICES,           256 << 10 },
+	{ LUMP_SHADOW_MESH_MESHES,            32 << 10 },
+};
+
+// entity partitions of every map and their share of the partition text
+static const struct PartitionDesc_t
+{
+	const char* pszName;
+	double share;
+	bool hasHeader; // with num_models
+} s_partitions[] =
+{
+	{ "env",    0.25, false },
+	{ "fx",     0.10, false },
+	{ "script", 0.40, true },
+	{ "snd",    0.10, false },
+	{ "spawn",  0.15, false },
+};
+
+// splitmix64
+uint64_t CCorpusRandom::Next()
+{
+	uint64_t z = (m_nState += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+void CCorpusRandom::Fill(char* const pData, const size_t nSize)
+{
+	size_t i = 0;
+
+	for (; i + sizeof(uint64_t) <= nSize; i += sizeof(uint64_t))
+	{
+		const uint64_t v = Next();
+		memcpy(pData + i, &v, sizeof(v));
+	}
+
+	if (i < nSize)
+	{
+		const uint64_t v = Next();
+		memcpy(pData + i, &v, nSize - i);
+	}
+}
+
+// a v12.1 brush model with plausible offsets, the rest is noise
+static void GenerateBrushModel(CCorpusRandom& random, std::vector<char>& brushModel)
+{
+	const size_t bvhNodeIndex = sizeof(r5::v121::dbrushmodel_t) + 4 * size_t(random.RandomInt(0, 40));
+	const size_t size = bvhNodeIndex + size_t(random.RandomInt(8, 900));
+
+	brushModel.resize(size);
+	random.Fill(brushModel.data(), size);
+
+	r5::v121::dbrushmodel_t* const pBrushModel = reinterpret_cast<r5::v121::dbrushmodel_t*>(brushModel.data());
+
+	pBrushModel->model.contentMasksIndex = int(bvhNodeIndex);
+	pBrushModel->model.surfacePropsIndex = int(bvhNodeIndex);
+	pBrushModel->model.surfaceNamesIndex = int(bvhNodeIndex);
+	pBrushModel->model.headerCount = 1;
+
+	pBrushModel->header.unk = 0;
+	pBrushModel->header.bvhNodeIndex = int(bvhNodeIndex);
+	pBrushModel->header.vertIndex = int(bvhNodeIndex);
+	pBrushModel->header.bvhLeafIndex = int(bvhNodeIndex);
+	pBrushModel->header.unkIndex = int(bvhNodeIndex);
+	pBrushModel->header.unkNew = 0;
+	pBrushModel->header.origin[0] = float(random.RandomInt(-16384, 16384));
+	pBrushModel->header.origin[1] = float(random.RandomInt(-16384, 16384));
+	pBrushModel->header.origin[2] = float(random.RandomInt(-4096, 4096));
+	pBrushModel->header.scale = 1.0f / 65536.0f;
+}
+
+void GenerateEntityPartition(CCorpusRandom& random, const size_t numObjects, const int numModels, std::string& output)
+{
+	output.clear();
+
+	if (numModels >= 0)
+		output += Format("ENTITIES02 num_models=%d\n", numModels);
+
+	std::vector<char> brushModel;
+	std::string encoded;
+
+	for (size_t i = 0; i < numObjects; i++)
+	{
+		const int x = random.RandomInt(-16384, 16384);
+		const int y = random.RandomInt(-16384, 16384);
+		const int z = random.RandomInt(-4096, 4096);
+
+		output += "{\n";
+
+		if (i % 3)
+		{
+			output += Format("\"classname\" \"info_target\"\n\"targetname\" \"target_%zu\"\n\"origin\" \"%d %d %d\"\n\"angles\" \"0 %d 0\"\n",
+				i, x, y, z, random.RandomInt(0, 359));
+		}
+		else
+		{
+			output += Format("\"classname\" \"func_brush\"\n\"origin\" \"%d %d %d\"\n\"model\" \"*%zu\"\n", x, y, z, i / 3 + 1);
+
+			GenerateBrushModel(random, brushModel);
+
+			for (size_t offset = 0, chunk = 0; offset < brushModel.size(); offset += COLL_CHUNK_SIZE, chunk++)
+			{
+				Base64Encode(brushModel.data() + offset, std::min(brushModel.size() - offset, size_t(COLL_CHUNK_SIZE)), encoded);
+				output += Format("\"*coll%zu\" \"%s\"\n", chunk, encoded.c_str());
+			}
+		}
+
+		output += "}\n";
+	}
+
+	output += '\0';
+}
+
+void GenerateLightProbes_v51(CCorpusRandom& random, const size_t numLightProbes, std::vector<char>& output)
+{
+	output.resize(numLightProbes * sizeof(r5::v51::dlightprobe_t));
+	random.Fill(output.data(), output.size());
+}
+
+static bool WriteFile(const std::string& filePath, const void* const pData, const size_t nSize, size_t& totalSize)
+{
+	CNativeFile out;
+
+	if (!out.Open(filePath, CNativeFile::WRITE) || !out.Write(pData, nSize))
+	{
+		printf("Failed to write \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	totalSize += nSize;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: generates a synthetic map, see SyntheticMapDesc_t
+// Input  : &directory - has to exist
+//			&desc -
+//			&bspPath - the path of the .bsp written
+//			&totalSize - the size of all files written
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool GenerateSyntheticMap(const std::string& directory, const SyntheticMapDesc_t& desc, std::string& bspPath, size_t& totalSize)
+{
+	CCorpusRandom random(desc.seed);
+	totalSize = 0;
+
+	bspPath = (fs::path(directory) / desc.name).string();
+	const std::string pathNoExtension = RemoveExtension(bspPath);
+
+	BSPHeader_t header = {};
+	header.ident = IDBSPHEADER;
+	header.version = short(desc.version);
+	header.mapRevision = int(desc.seed & 0xffff);
+	header.lastLump = LUMP_COUNT - 1;
+
+	// laid out in lump order, as if they were stored in the bsp
+	int nextLumpOffset = sizeof(BSPHeader_t);
+
+	std::string text;
+	std::vector<char> data;
+
+	const size_t numEntities = std::max(size_t(1), size_t(desc.scale * ENTITY_TEXT_SIZE / AVERAGE_ENTITY_SIZE));
+
+	for (const LumpSize_t& lump : s_lumpSizes)
+	{
+		const size_t scaledSize = std::max(size_t(4), size_t(lump.size * desc.scale) & ~size_t(3));
+		const char* pData = nullptr;
+		size_t size = 0;
+
+		switch (lump.index)
+		{
+		case LUMP_ENTITIES:
+		{
+			GenerateEntityPartition(random, std::max(size_t(1), size_t(numEntities * ENTITIES_LUMP_SHARE)), -1, text);
+			pData = text.data();
+			size = text.size();
+			break;
+		}
+		case LUMP_ENTITY_PARTITIONS:
+		{
+			if (desc.version < 48)
+				continue;
+
+			text.clear();
+			text.resize(sizeof(dentitypartitionheader_t));
+			reinterpret_cast<dentitypartitionheader_t*>(&text[0])->ident = dentitypartitionheader_t::VERSION;
+			text += '*';
+
+			for (size_t i = 0; i < V_ARRAYSIZE(s_partitions); i++)
+			{
+				text += i ? " " : "";
+				text += s_partitions[i].pszName;
+			}
+
+			text += '\0';
+
+			pData = text.data();
+			size = text.size();
+			break;
+		}
+		case LUMP_GAME_LUMP:
+		{
+			const size_t headerSize = sizeof(dgamelumpheader_t) + sizeof(r5::dgamelump_t);
+			data.resize(headerSize + scaledSize);
+			random.Fill(data.data() + headerSize, scaledSize);
+
+			reinterpret_cast<dgamelumpheader_t*>(data.data())->lumpCount = 1;
+
+			r5::dgamelump_t* const pGameLump = reinterpret_cast<r5::dgamelump_t*>(data.data() + sizeof(dgamelumpheader_t));
+			pGameLump->id = GAMELUMP_STATIC_PROPS;
+			pGameLump->flags = 0;
+			pGameLump->version = 14;
+			pGameLump->fileofs = nextLumpOffset + int(headerSize);
+			pGameLump->filelen = int(scaledSize);
+
+			pData = data.data();
+			size = data.size();
+			break;
+		}
+		case LUMP_LIGHTPROBES:
+		{
+			if (desc.version >= 51)
+			{
+				GenerateLightProbes_v51(random, scaledSize / sizeof(r5::v51::dlightprobe_t), data);
+			}
+			else
+			{
+				data.resize((scaledSize / sizeof(dlightprobe_t)) * sizeof(dlightprobe_t));
+				random.Fill(data.data(), data.size());
+			}
+
+			pData = data.data();
+			size = data.size();
+			break;
+		}
+		default:
+		{
+			data.resize(scaledSize);
+			random.Fill(data.data(), data.size());
+
+			pData = data.data();
+			size = data.size();
+			break;
+		}
+		}
+
+		if (!size)
+			continue;
+
+		header.lumps[lump.index].fileofs = nextLumpOffset;
+		header.lumps[lump.index].filelen = int(size);
+		nextLumpOffset += int(size);
+
+		if (!WriteFile(Format("%s.%04x.bsp_lump", bspPath.c_str(), lump.index), pData, size, totalSize))
+			return false;
+	}
+
+	if (desc.version >= 48)
+	{
+		for (const PartitionDesc_t& partition : s_partitions)
+		{
+			const size_t numObjects = std::max(size_t(1), size_t(numEntities * (1.0 - ENTITIES_LUMP_SHARE) * partition.share));
+			const int numModels = partition.hasHeader ? int(numObjects / 3 + 1) : -1;
+
+			GenerateEntityPartition(random, numObjects, numModels, text);
+
+			// the headerless ones still carry the partition header
+			if (numModels < 0)
+				text.insert(0, "ENTITIES01\n");
+
+			if (!WriteFile(Format("%s_%s.ent", pathNoExtension.c_str(), partition.pszName), text.data(), text.size(), totalSize))
+				return false;
+		}
+	}
+
+	return WriteFile(bspPath, &header, sizeof(header), totalSize);
+}
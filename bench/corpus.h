@@ -0,0 +1,44 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+// Purpose: small deterministic random generator for the synthetic corpus; the
+//			standard distributions differ between implementations, this gives
+//			the same bytes on every platform
+//-----------------------------------------------------------------------------
+class CCorpusRandom
+{
+public:
+	CCorpusRandom(const uint64_t nSeed) : m_nState(nSeed) {}
+
+	uint64_t Next();
+	// in [nMin, nMax]
+	inline int RandomInt(const int nMin, const int nMax) { return nMin + int(Next() % uint64_t(nMax - nMin + 1)); }
+	void Fill(char* const pData, const size_t nSize);
+
+private:
+	uint64_t m_nState;
+};
+
+// what a synthetic map looks like
+struct SyntheticMapDesc_t
+{
+	SyntheticMapDesc_t() : version(51), scale(1.0), seed(1) {}
+
+	std::string name; // file name of the bsp, e.g. mp_bench_v51.bsp
+	int version; // 47 to 51
+	double scale; // lump sizes relative to a mid-sized map of about 64 MiB
+	uint64_t seed;
+};
+
+// writes the map's .bsp, its .bsp_lump files and (from v48 on) its entity
+// partitions into directory; returns the path of the .bsp and the size of all
+// files written
+bool GenerateSyntheticMap(const std::string& directory, const SyntheticMapDesc_t& desc, std::string& bspPath, size_t& totalSize);
+
+// an entity partition or entities lump of numObjects objects, every third of
+// them with a v12.1 brush model split into *coll fields; headerless if
+// numModels is negative. Always ends with a '\0'
+void GenerateEntityPartition(CCorpusRandom& random, const size_t numObjects, const int numModels, std::string& output);
+
+// numLightProbes v51 (44 byte) lightprobes
+void GenerateLightProbes_v51(CCorpusRandom& random, const size_t numLightProbes, std::vector<char>& output);
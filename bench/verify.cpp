@@ -0,0 +1,398 @@
+#include "stdafx.h"
+#include "corpus.h"
+
+#include <CommandLine.h>
+#include <bspfile.h>
+#include <versions.h>
+#include <threadpool.h>
+#include <outputset.h>
+#include <cpufeatures.h>
+#include <stltools.h>
+#include <nativefile.h>
+
+// large enough for the entity partitions and the entities lump to be read in
+// several pieces, see ENTITY_PARTITION_READ_SIZE
+#define VERIFY_DEFAULT_SCALE "0.25"
+
+// small enough for the transformed lumps to be streamed in several pieces
+#define VERIFY_MEMORY_CAP (512 * 1024)
+
+// FNV-1a
+#define VERIFY_HASH_OFFSET 0xCBF29CE484222325ULL
+#define VERIFY_HASH_PRIME 0x100000001B3ULL
+
+//-----------------------------------------------------------------------------
+// Purpose: hash of the files of a map of the corpus at the default scale, as
+//			converted by bspconv before any of the optimized paths existed
+//
+// The reference shares code with every variant (the brush model and Base64
+// conversion of the entity partitions, for one), so a bug in it would go
+// unnoticed by comparing against it alone. Regenerate these only when the
+// conversion output is meant to change, see HashMapFiles.
+//-----------------------------------------------------------------------------
+struct GoldenHash_t
+{
+	int version;
+	bool packed;
+	uint64_t hash;
+};
+
+static const GoldenHash_t s_goldenHashes[] =
+{
+	{ 47, false, 0x29698076DC4F15F1ULL },
+	{ 48, false, 0x200AE6879CBA207CULL },
+	{ 49, false, 0xDA783A0711AB221AULL },
+	{ 50, false, 0x7E61311CDE6C0A5DULL },
+	{ 51, false, 0x0829FD3F2B8ADB86ULL },
+	{ 47, true, 0xE2C1E34CD923B039ULL },
+	{ 48, true, 0xFCAD0113A6069B0FULL },
+	{ 49, true, 0xDF886E30EF374D0EULL },
+	{ 50, true, 0x47BD40BD172EEC5DULL },
+	{ 51, true, 0x032711650F455C34ULL },
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: a way of converting the corpus that has to produce the same files,
+//			byte for byte, as the reference
+//-----------------------------------------------------------------------------
+struct VerifyVariant_t
+{
+	const char* name;
+	bool simd; // SIMD lightprobe expansion and Base64, see CPU_SetSIMDEnabled
+	bool pool; // lumps and entity partitions are converted on the pool
+	bool streamPartitions; // CEntityPartitionStream instead of CEntityPartitionMgr
+	bool parallelWrite;
+	size_t memoryCap;
+	bool packedOnly; // only changes how packed bsps are written
+};
+
+// the plainest path: scalar, sequential, buffered partitions, uncapped
+static const VerifyVariant_t s_reference = { "reference", false, false, false, false, 0, false };
+
+static const VerifyVariant_t s_variants[] =
+{
+	{ "simd", true, false, false, false, 0, false },
+	{ "pool", false, true, false, false, 0, false },
+	{ "streamed partitions", false, false, true, false, 0, false },
+	{ "parallelwrite", false, true, false, true, 0, true },
+	{ "memcap", false, false, false, false, VERIFY_MEMORY_CAP, true },
+	{ "all", true, true, true, true, VERIFY_MEMORY_CAP, false },
+};
+
+// generates the corpus into directory and converts every map of it the way
+// variant says, committing the outputs over the inputs
+static bool ConvertCorpus(const std::string& directory, const double scale, const VerifyVariant_t& variant, const bool packAllLumps, CThreadPool& pool)
+{
+	std::error_code ec;
+	fs::create_directories(directory, ec);
+
+	if (ec)
+	{
+		printf("Failed to create \"%s\"\n", directory.c_str());
+		return false;
+	}
+
+	ConvertOptions_t convertOptions;
+	convertOptions.packAllLumps = packAllLumps;
+	convertOptions.parallelWrite = variant.parallelWrite;
+	convertOptions.memoryCap = variant.memoryCap;
+	convertOptions.bufferPartitions = !variant.streamPartitions;
+
+	CPU_SetSIMDEnabled(variant.simd);
+	g_pThreadPool = variant.pool ? &pool : nullptr;
+
+	bool success = true;
+
+	for (int version = 47; version <= 51 && success; version++)
+	{
+		SyntheticMapDesc_t desc;
+		desc.name = Format("mp_verify_v%d.bsp", version);
+		desc.version = version;
+		desc.scale = scale;
+		desc.seed = uint64_t(version);
+
+		std::string bspPath;
+		size_t totalSize;
+
+		if (!GenerateSyntheticMap(directory, desc, bspPath, totalSize))
+		{
+			printf("Failed to generate synthetic map \"%s\"\n", desc.name.c_str());
+			success = false;
+			break;
+		}
+
+		BSPHeader_t header;
+		CNativeFile bspIn;
+
+		if (!bspIn.Open(bspPath, CNativeFile::READ) || bspIn.Read(&header, sizeof(header)) != sizeof(header))
+		{
+			printf("Failed to read \"%s\"\n", bspPath.c_str());
+			success = false;
+			break;
+		}
+
+		bspIn.Close();
+
+		COutputSet outputs;
+		std::string output;
+
+		CScopedMsgBuffer msgBuffer(&output);
+
+		try
+		{
+			ConvertBSP(bspPath, reinterpret_cast<char*>(&header), convertOptions, outputs);
+		}
+		catch (const CConvertError& error)
+		{
+			outputs.Discard();
+			printf("%s%s: ERROR: %s", output.c_str(), bspPath.c_str(), error.what());
+			success = false;
+			break;
+		}
+
+		if (!outputs.Commit())
+		{
+			printf("Failed to commit the outputs of \"%s\"\n", bspPath.c_str());
+			success = false;
+		}
+	}
+
+	g_pThreadPool = nullptr;
+	CPU_SetSIMDEnabled(true);
+
+	return success;
+}
+
+static bool ReadWholeFile(const fs::path& filePath, std::vector<char>& data)
+{
+	CNativeFile in;
+	if (!in.Open(filePath.string(), CNativeFile::READ))
+		return false;
+
+	data.resize(size_t(in.GetSize()));
+	return in.Read(data.data(), data.size()) == data.size();
+}
+
+// hashes the names and contents of the files of a map, in the order of their
+// names; the maps of the corpus don't share a prefix with each other
+static bool HashMapFiles(const std::string& directory, const std::string& mapName, uint64_t& hash)
+{
+	std::vector<std::string> names;
+
+	for (const fs::directory_entry& entry : fs::directory_iterator(directory))
+	{
+		const std::string name = entry.path().filename().string();
+
+		if (name.compare(0, mapName.size(), mapName) == 0)
+			names.push_back(name);
+	}
+
+	std::sort(names.begin(), names.end());
+
+	hash = VERIFY_HASH_OFFSET;
+	std::vector<char> data;
+
+	const auto hashBytes = [&hash](const char* const pData, const size_t nSize)
+	{
+		for (size_t i = 0; i < nSize; i++)
+			hash = (hash ^ uint8_t(pData[i])) * VERIFY_HASH_PRIME;
+	};
+
+	for (const std::string& name : names)
+	{
+		if (!ReadWholeFile(fs::path(directory) / name, data))
+			return false;
+
+		// the terminator keeps the name from running into the data
+		hashBytes(name.c_str(), name.size() + 1);
+		hashBytes(data.data(), data.size());
+	}
+
+	return !names.empty();
+}
+
+// checks the reference conversion of the corpus against the golden hashes
+static bool CheckGoldenHashes(const std::string& referenceDir, const bool packAllLumps)
+{
+	bool matches = true;
+
+	for (const GoldenHash_t& golden : s_goldenHashes)
+	{
+		if (golden.packed != packAllLumps)
+			continue;
+
+		const std::string mapName = Format("mp_verify_v%d", golden.version);
+		uint64_t hash;
+
+		if (!HashMapFiles(referenceDir, mapName, hash))
+		{
+			printf("  unreadable: %s\n", mapName.c_str());
+			matches = false;
+		}
+		else if (hash != golden.hash)
+		{
+			printf("  differs from the golden hash: %s (%016llx, golden %016llx)\n", mapName.c_str(), (unsigned long long)hash, (unsigned long long)golden.hash);
+			matches = false;
+		}
+	}
+
+	return matches;
+}
+
+// compares the files of directory to the ones in referenceDir, reporting
+// every file that is missing, extra or differs
+static bool CompareDirectories(const std::string& referenceDir, const std::string& directory)
+{
+	std::vector<std::string> referenceNames;
+	std::vector<std::string> names;
+
+	for (const fs::directory_entry& entry : fs::directory_iterator(referenceDir))
+		referenceNames.push_back(entry.path().filename().string());
+
+	for (const fs::directory_entry& entry : fs::directory_iterator(directory))
+		names.push_back(entry.path().filename().string());
+
+	std::sort(referenceNames.begin(), referenceNames.end());
+	std::sort(names.begin(), names.end());
+
+	bool identical = true;
+
+	std::vector<std::string> missing;
+	std::set_difference(referenceNames.begin(), referenceNames.end(), names.begin(), names.end(), std::back_inserter(missing));
+
+	std::vector<std::string> extra;
+	std::set_difference(names.begin(), names.end(), referenceNames.begin(), referenceNames.end(), std::back_inserter(extra));
+
+	for (const std::string& name : missing)
+	{
+		printf("  missing: %s\n", name.c_str());
+		identical = false;
+	}
+
+	for (const std::string& name : extra)
+	{
+		printf("  extra: %s\n", name.c_str());
+		identical = false;
+	}
+
+	std::vector<char> referenceData;
+	std::vector<char> data;
+
+	for (const std::string& name : names)
+	{
+		if (!std::binary_search(referenceNames.begin(), referenceNames.end(), name))
+			continue;
+
+		if (!ReadWholeFile(fs::path(referenceDir) / name, referenceData) || !ReadWholeFile(fs::path(directory) / name, data))
+		{
+			printf("  unreadable: %s\n", name.c_str());
+			identical = false;
+			continue;
+		}
+
+		if (data == referenceData)
+			continue;
+
+		const size_t commonSize = std::min(data.size(), referenceData.size());
+		const size_t offset = size_t(std::mismatch(data.begin(), data.begin() + commonSize, referenceData.begin()).first - data.begin());
+
+		printf("  differs: %s (size %zu, reference %zu, first difference at %zu)\n", name.c_str(), data.size(), referenceData.size(), offset);
+		identical = false;
+	}
+
+	return identical;
+}
+
+int main(int argc, char** argv)
+{
+	printf("bspconv_verify - Copyright (c) %s, rexx\n", &__DATE__[7]);
+
+	const CommandLine cmdline(argc, argv);
+
+	if (cmdline.HasParam("-help"))
+	{
+		printf("\nUsage: bspconv_verify [-scale F] [-dir path] [-keep]\n");
+		printf("\n");
+		printf("Converts the synthetic corpus along every optimized path and checks that the\n");
+		printf("output matches the plain scalar, sequential conversion byte for byte. At the\n");
+		printf("default scale that conversion is checked against the output of the original\n");
+		printf("converter as well.\n");
+		printf("\n");
+		printf("Options:\n");
+		printf("  -scale F     Size of the synthetic maps relative to a mid-sized map (default " VERIFY_DEFAULT_SCALE ")\n");
+		printf("  -dir path    Where the converted corpora are kept (default: a temporary directory)\n");
+		printf("  -keep        Keep the converted corpora in the temporary directory\n");
+		return 0;
+	}
+
+	const double scale = atof(cmdline.GetParamValue("-scale", VERIFY_DEFAULT_SCALE));
+
+	if (scale <= 0.0)
+		Error("-scale has to be larger than 0\n");
+
+	// the golden hashes are of the corpus at the default scale
+	const bool checkGolden = scale == atof(VERIFY_DEFAULT_SCALE);
+
+	// a directory that has been passed in is never removed
+	std::string rootDir = cmdline.GetParamValue("-dir", "");
+	const bool isTempDir = rootDir.empty();
+
+	if (isTempDir)
+		rootDir = (fs::temp_directory_path() / Format("bspconv_verify_%llx", (unsigned long long)CScopeTimer::GetTime())).string();
+
+	printf("Synthetic corpus: %s (scale %g)\n", rootDir.c_str(), scale);
+
+	// at least one worker, so the pool paths really run concurrently
+	CThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+
+	size_t numFailed = 0;
+
+	for (const bool packAllLumps : { false, true })
+	{
+		const char* const mode = packAllLumps ? "packed" : "unpacked";
+		const std::string referenceDir = Format("%s/%s_reference", rootDir.c_str(), mode);
+
+		if (!ConvertCorpus(referenceDir, scale, s_reference, packAllLumps, pool))
+			Error("Failed to convert the %s reference corpus\n", mode);
+
+		if (checkGolden)
+		{
+			const bool matches = CheckGoldenHashes(referenceDir, packAllLumps);
+
+			printf("%-24s %-10s %s\n", "golden hashes", mode, matches ? "identical" : "DIFFERS");
+
+			if (!matches)
+				numFailed++;
+		}
+
+		for (size_t i = 0; i < sizeof(s_variants) / sizeof(s_variants[0]); i++)
+		{
+			const VerifyVariant_t& variant = s_variants[i];
+
+			if (variant.packedOnly && !packAllLumps)
+				continue;
+
+			const std::string directory = Format("%s/%s_%zu", rootDir.c_str(), mode, i);
+			const bool identical = ConvertCorpus(directory, scale, variant, packAllLumps, pool) && CompareDirectories(referenceDir, directory);
+
+			printf("%-24s %-10s %s\n", variant.name, mode, identical ? "identical" : "DIFFERS");
+
+			if (!identical)
+				numFailed++;
+		}
+	}
+
+	std::error_code ec;
+
+	if (isTempDir && !cmdline.HasParam("-keep"))
+		fs::remove_all(rootDir, ec);
+
+	if (numFailed)
+	{
+		printf("%zu conversion path(s) don't match the reference\n", numFailed);
+		return 1;
+	}
+
+	printf("All conversion paths match the reference\n");
+	return 0;
+}
@@ -5,9 +5,10 @@ CommandLine::CommandLine(int nArgsCount, char** args)
 {
     if (!args)
     {
-        char* tmp{};
+        // must outlive the constructor, argv is read later on
+        static char* s_emptyArgs[] = { nullptr };
         this->argc = 0;
-        this->argv = &tmp;
+        this->argv = s_emptyArgs;
     }
     else {
         this->argc = nArgsCount;
@@ -0,0 +1,317 @@
+#include "stdafx.h"
+#include "allocprofile.h"
+#include "nativefile.h"
+#include "stltools.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#define AllocUsableSize(p) _msize(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define AllocUsableSize(p) malloc_size(p)
+#else
+#include <malloc.h>
+#define AllocUsableSize(p) malloc_usable_size(p)
+#endif
+
+// deeper phases still count against their enclosing ones
+#define ALLOC_PROFILE_MAX_DEPTH 32
+
+struct AllocPhaseStats_t
+{
+	const char* pszName;
+	bool isLump;
+	uint64_t count; // times the phase ran
+	uint64_t timeNs; // summed over all threads
+	uint64_t numAllocs;
+	uint64_t numBytes; // as requested
+	int64_t peakLiveBytes; // as handed out by the heap
+};
+
+struct AllocFrame_t
+{
+	const char* pszName;
+	bool isLump;
+	int64_t nStartNs;
+	int64_t nStartLiveBytes;
+	int64_t nPeakLiveBytes;
+	uint64_t numAllocs;
+	uint64_t numBytes;
+};
+
+// plain data only, operator new can run before and after the thread's
+// destructors
+struct AllocThread_t
+{
+	AllocFrame_t frames[ALLOC_PROFILE_MAX_DEPTH];
+	int depth;
+	int64_t liveBytes;
+	bool inProfiler; // allocations of the profiler itself aren't counted
+};
+
+static thread_local AllocThread_t s_allocThread;
+
+static std::atomic<uint64_t> s_numAllocs(0);
+static std::atomic<uint64_t> s_numBytes(0);
+static std::atomic<int64_t> s_liveBytes(0);
+static std::atomic<int64_t> s_peakLiveBytes(0);
+
+static std::mutex s_phasesMutex;
+static std::vector<AllocPhaseStats_t> s_phases;
+static int64_t s_nProfileStartNs = 0;
+
+static void RecordAlloc(void* const pMem, const size_t nSize)
+{
+	AllocThread_t& thread = s_allocThread;
+
+	if (thread.inProfiler)
+		return;
+
+	const int64_t nUsable = int64_t(AllocUsableSize(pMem));
+	thread.liveBytes += nUsable;
+
+	s_numAllocs.fetch_add(1, std::memory_order_relaxed);
+	s_numBytes.fetch_add(nSize, std::memory_order_relaxed);
+
+	const int64_t nLive = s_liveBytes.fetch_add(nUsable, std::memory_order_relaxed) + nUsable;
+	int64_t nPeak = s_peakLiveBytes.load(std::memory_order_relaxed);
+
+	while (nLive > nPeak && !s_peakLiveBytes.compare_exchange_weak(nPeak, nLive, std::memory_order_relaxed))
+		;
+
+	const int depth = std::min(thread.depth, ALLOC_PROFILE_MAX_DEPTH);
+
+	for (int i = 0; i < depth; i++)
+	{
+		AllocFrame_t& frame = thread.frames[i];
+
+		frame.numAllocs++;
+		frame.numBytes += nSize;
+		frame.nPeakLiveBytes = std::max(frame.nPeakLiveBytes, thread.liveBytes - frame.nStartLiveBytes);
+	}
+}
+
+static void RecordFree(void* const pMem)
+{
+	AllocThread_t& thread = s_allocThread;
+
+	if (thread.inProfiler)
+		return;
+
+	// memory allocated before profiling started is taken off too, live bytes
+	// only matter relative to the start of a phase
+	const int64_t nUsable = int64_t(AllocUsableSize(pMem));
+	thread.liveBytes -= nUsable;
+	s_liveBytes.fetch_sub(nUsable, std::memory_order_relaxed);
+}
+
+static void* ProfiledAlloc(const size_t nSize)
+{
+	void* const pMem = malloc(nSize ? nSize : 1);
+
+	if (pMem && g_bAllocProfileEnabled.load(std::memory_order_relaxed))
+		RecordAlloc(pMem, nSize);
+
+	return pMem;
+}
+
+static void ProfiledFree(void* const pMem)
+{
+	if (!pMem)
+		return;
+
+	if (g_bAllocProfileEnabled.load(std::memory_order_relaxed))
+		RecordFree(pMem);
+
+	free(pMem);
+}
+
+void* operator new(size_t nSize)
+{
+	void* const pMem = ProfiledAlloc(nSize);
+
+	if (!pMem)
+		throw std::bad_alloc();
+
+	return pMem;
+}
+
+void* operator new[](size_t nSize)
+{
+	void* const pMem = ProfiledAlloc(nSize);
+
+	if (!pMem)
+		throw std::bad_alloc();
+
+	return pMem;
+}
+
+void* operator new(size_t nSize, const std::nothrow_t&) noexcept { return ProfiledAlloc(nSize); }
+void* operator new[](size_t nSize, const std::nothrow_t&) noexcept { return ProfiledAlloc(nSize); }
+
+void operator delete(void* pMem) noexcept { ProfiledFree(pMem); }
+void operator delete[](void* pMem) noexcept { ProfiledFree(pMem); }
+void operator delete(void* pMem, size_t) noexcept { ProfiledFree(pMem); }
+void operator delete[](void* pMem, size_t) noexcept { ProfiledFree(pMem); }
+void operator delete(void* pMem, const std::nothrow_t&) noexcept { ProfiledFree(pMem); }
+void operator delete[](void* pMem, const std::nothrow_t&) noexcept { ProfiledFree(pMem); }
+
+//-----------------------------------------------------------------------------
+// Purpose: opens a phase on the calling thread, see CScopeTimer
+// Input  : *pszName - has to be a literal or otherwise outlive the profile
+//			isLump - whether pszName is a lump type rather than a phase
+//-----------------------------------------------------------------------------
+void AllocProfileEnterPhase(const char* const pszName, const bool isLump)
+{
+	AllocThread_t& thread = s_allocThread;
+
+	if (thread.depth < ALLOC_PROFILE_MAX_DEPTH)
+	{
+		AllocFrame_t& frame = thread.frames[thread.depth];
+
+		frame.pszName = pszName;
+		frame.isLump = isLump;
+		frame.nStartNs = CScopeTimer::GetTime();
+		frame.nStartLiveBytes = thread.liveBytes;
+		frame.nPeakLiveBytes = 0;
+		frame.numAllocs = 0;
+		frame.numBytes = 0;
+	}
+
+	thread.depth++;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: closes the innermost phase of the calling thread and adds it to the
+//			profile
+//-----------------------------------------------------------------------------
+void AllocProfileLeavePhase()
+{
+	AllocThread_t& thread = s_allocThread;
+	thread.depth--;
+
+	if (thread.depth >= ALLOC_PROFILE_MAX_DEPTH)
+		return;
+
+	const AllocFrame_t& frame = thread.frames[thread.depth];
+	const uint64_t nTimeNs = uint64_t(CScopeTimer::GetTime() - frame.nStartNs);
+
+	thread.inProfiler = true;
+	{
+		std::lock_guard<std::mutex> lock(s_phasesMutex);
+
+		// names of the same text can live at different addresses
+		auto it = std::find_if(s_phases.begin(), s_phases.end(), [&frame](const AllocPhaseStats_t& phase) {
+			return phase.isLump == frame.isLump && !strcmp(phase.pszName, frame.pszName);
+		});
+
+		if (it == s_phases.end())
+		{
+			s_phases.push_back({ frame.pszName, frame.isLump, 0, 0, 0, 0, 0 });
+			it = s_phases.end() - 1;
+		}
+
+		it->count++;
+		it->timeNs += nTimeNs;
+		it->numAllocs += frame.numAllocs;
+		it->numBytes += frame.numBytes;
+		it->peakLiveBytes = std::max(it->peakLiveBytes, frame.nPeakLiveBytes);
+	}
+	thread.inProfiler = false;
+}
+
+CAllocLumpScope::CAllocLumpScope(const int lumpIdx)
+{
+	m_bEntered = g_bAllocProfileEnabled.load(std::memory_order_relaxed);
+
+	if (m_bEntered)
+		AllocProfileEnterPhase(GetLumpName(lumpIdx), true);
+}
+
+CAllocLumpScope::~CAllocLumpScope()
+{
+	if (m_bEntered)
+		AllocProfileLeavePhase();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: starts counting allocations
+//-----------------------------------------------------------------------------
+void CAllocProfiler::Start()
+{
+	{
+		std::lock_guard<std::mutex> lock(s_phasesMutex);
+		s_phases.clear();
+	}
+
+	s_numAllocs.store(0, std::memory_order_relaxed);
+	s_numBytes.store(0, std::memory_order_relaxed);
+	s_liveBytes.store(0, std::memory_order_relaxed);
+	s_peakLiveBytes.store(0, std::memory_order_relaxed);
+
+	s_nProfileStartNs = CScopeTimer::GetTime();
+	g_bAllocProfileEnabled.store(true, std::memory_order_relaxed);
+}
+
+static void WritePhases(std::string& json, const std::vector<AllocPhaseStats_t>& phases, const bool isLump)
+{
+	bool first = true;
+
+	for (const AllocPhaseStats_t& phase : phases)
+	{
+		if (phase.isLump != isLump)
+			continue;
+
+		json += first ? "\n    {\"name\":" : ",\n    {\"name\":";
+		AppendJsonString(json, phase.pszName);
+		json += Format(",\"count\":%llu,\"timeMs\":%.3f,\"numAllocs\":%llu,\"allocBytes\":%llu,\"peakLiveBytes\":%lld}",
+			(unsigned long long)phase.count, phase.timeNs / 1e6, (unsigned long long)phase.numAllocs,
+			(unsigned long long)phase.numBytes, (long long)phase.peakLiveBytes);
+		first = false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: stops counting and writes the profile, phases with the most bytes
+//			allocated first
+// Input  : &filePath -
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool CAllocProfiler::Stop(const std::string& filePath)
+{
+	g_bAllocProfileEnabled.store(false, std::memory_order_relaxed);
+
+	const uint64_t nTimeNs = uint64_t(CScopeTimer::GetTime() - s_nProfileStartNs);
+
+	std::vector<AllocPhaseStats_t> phases;
+	{
+		std::lock_guard<std::mutex> lock(s_phasesMutex);
+		phases = s_phases;
+	}
+
+	std::sort(phases.begin(), phases.end(), [](const AllocPhaseStats_t& a, const AllocPhaseStats_t& b) {
+		return a.numBytes > b.numBytes;
+	});
+
+	std::string json = Format("{\n  \"timeMs\":%.3f,\n  \"totals\":{\"numAllocs\":%llu,\"allocBytes\":%llu,\"peakLiveBytes\":%lld},\n  \"phases\":[",
+		nTimeNs / 1e6, (unsigned long long)s_numAllocs.load(), (unsigned long long)s_numBytes.load(), (long long)s_peakLiveBytes.load());
+	WritePhases(json, phases, false);
+	json += "\n  ],\n  \"lumpTypes\":[";
+	WritePhases(json, phases, true);
+	json += "\n  ]\n}\n";
+
+	CNativeFile out;
+	if (!out.Open(filePath, CNativeFile::WRITE) || !out.Write(json.data(), json.size()))
+	{
+		printf("Failed to write allocation profile \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	printf("Wrote allocation profile to \"%s\"\n", filePath.c_str());
+	return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+// Purpose: counts the heap allocations of every CScopeTimer (TIME_SCOPE) phase
+//			and of every lump type
+//
+// While profiling, the global operator new and delete count each allocation
+// against all phases open on the allocating thread, so a phase includes the
+// phases nested in it. Peak live bytes are per thread: the most a phase had
+// allocated and not yet freed at once on the thread it ran on. When not
+// profiling the operators cost a single flag check.
+//-----------------------------------------------------------------------------
+class CAllocProfiler
+{
+public:
+	static void Start();
+	// stops profiling and writes out everything counted since Start
+	static bool Stop(const std::string& filePath);
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: counts the allocations of its scope against a lump type
+//-----------------------------------------------------------------------------
+class CAllocLumpScope
+{
+public:
+	CAllocLumpScope(const int lumpIdx);
+	~CAllocLumpScope();
+
+private:
+	bool m_bEntered;
+};
@@ -0,0 +1,263 @@
+#include "stdafx.h"
+#include "arena.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// smallest block requested from the OS
+#define ARENA_MIN_BLOCK_SIZE (4 << 20)
+
+// huge page size blocks are rounded to when huge pages are requested; the
+// actual size on Windows is queried from the OS
+#define ARENA_HUGE_PAGE_SIZE (2 << 20)
+
+// an arena holds on to at most this much memory between maps
+#define ARENA_MAX_RETAINED_SIZE (size_t(256) << 20)
+
+// counted for the thread that allocates, not per arena, so the allocations of
+// a lump can be told apart from the other lumps of its map
+static thread_local ArenaAllocStats_t s_threadAllocStats = {};
+
+static inline size_t AlignUp(const size_t nValue, const size_t nAlignment)
+{
+	return (nValue + nAlignment - 1) & ~(nAlignment - 1);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CArena constructor/destructor
+//-----------------------------------------------------------------------------
+CArena::CArena()
+{
+	m_nBytesUsed = 0;
+	m_nBytesReserved = 0;
+	m_nPeakBytesUsed = 0;
+	m_nNextBlockSize = 0;
+	m_bUseHugePages = false;
+}
+CArena::~CArena()
+{
+	for (Block_t& block : m_blocks)
+		FreeBlock(block);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: allocates memory that stays valid until the next Reset
+// Input  : nSize -
+//			nAlignment - power of two
+// Output : pointer to the memory, never nullptr
+//-----------------------------------------------------------------------------
+void* CArena::Alloc(const size_t nSize, const size_t nAlignment)
+{
+	s_threadAllocStats.numAllocs++;
+	s_threadAllocStats.numBytes += nSize;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_blocks.empty())
+	{
+		Block_t& block = m_blocks.back();
+		const size_t nOffset = AlignUp(size_t(block.pData) + block.nUsed, nAlignment) - size_t(block.pData);
+
+		if (nOffset + nSize <= block.nSize)
+		{
+			m_nBytesUsed += nOffset + nSize - block.nUsed;
+			m_nPeakBytesUsed = std::max(m_nPeakBytesUsed, m_nBytesUsed);
+
+			block.nUsed = nOffset + nSize;
+			return block.pData + nOffset;
+		}
+	}
+
+	Block_t block;
+	if (!AllocBlock(std::max({ nSize + nAlignment, size_t(ARENA_MIN_BLOCK_SIZE), m_nNextBlockSize }), block))
+		ConvertError("Failed to allocate %zu bytes of lump memory\n", nSize);
+
+	m_nNextBlockSize = 0;
+
+	const size_t nOffset = AlignUp(size_t(block.pData), nAlignment) - size_t(block.pData);
+	block.nUsed = nOffset + nSize;
+
+	m_blocks.push_back(block);
+
+	m_nBytesUsed += block.nUsed;
+	m_nBytesReserved += block.nSize;
+	m_nPeakBytesUsed = std::max(m_nPeakBytesUsed, m_nBytesUsed);
+
+	return block.pData + nOffset;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: releases all allocations
+//
+// If the last use needed more than one block, they are all given back and the
+// next block, allocated once the arena is used again, is made large enough for
+// all of it; so the following uses usually get by with one block.
+//-----------------------------------------------------------------------------
+void CArena::Reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	const bool keepBlock = m_blocks.size() == 1 && m_blocks[0].nSize <= ARENA_MAX_RETAINED_SIZE;
+
+	if (keepBlock)
+	{
+		m_blocks[0].nUsed = 0;
+	}
+	else
+	{
+		for (Block_t& block : m_blocks)
+			FreeBlock(block);
+
+		m_blocks.clear();
+		m_nBytesReserved = 0;
+
+		m_nNextBlockSize = m_nPeakBytesUsed <= ARENA_MAX_RETAINED_SIZE ? m_nPeakBytesUsed : 0;
+	}
+
+	m_nBytesUsed = 0;
+	m_nPeakBytesUsed = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: gets a block of memory from the OS
+// Input  : nMinSize -
+//			&block -
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool CArena::AllocBlock(const size_t nMinSize, Block_t& block)
+{
+	block.pData = nullptr;
+	block.nSize = 0;
+	block.nUsed = 0;
+
+#ifdef _WIN32
+	if (m_bUseHugePages)
+	{
+		// requires the "Lock pages in memory" privilege, silently falls back
+		// to regular pages without it
+		const size_t nLargePageSize = GetLargePageMinimum();
+
+		if (nLargePageSize)
+		{
+			const size_t nSize = AlignUp(nMinSize, nLargePageSize);
+			block.pData = reinterpret_cast<char*>(VirtualAlloc(nullptr, nSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+
+			if (block.pData)
+			{
+				block.nSize = nSize;
+				return true;
+			}
+		}
+	}
+
+	const size_t nSize = AlignUp(nMinSize, 64 * 1024);
+	block.pData = reinterpret_cast<char*>(VirtualAlloc(nullptr, nSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+
+	if (!block.pData)
+		return false;
+
+	block.nSize = nSize;
+#else
+	const size_t nSize = AlignUp(nMinSize, m_bUseHugePages ? ARENA_HUGE_PAGE_SIZE : 4096);
+	void* pData = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+	// only succeeds if huge pages have been reserved by the admin
+	if (m_bUseHugePages)
+		pData = mmap(nullptr, nSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+	if (pData == MAP_FAILED)
+	{
+		pData = mmap(nullptr, nSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (pData == MAP_FAILED)
+			return false;
+
+#ifdef MADV_HUGEPAGE
+		// transparent huge pages, a hint that is ignored where unavailable
+		if (m_bUseHugePages)
+			madvise(pData, nSize, MADV_HUGEPAGE);
+#endif
+	}
+
+	block.pData = reinterpret_cast<char*>(pData);
+	block.nSize = nSize;
+#endif
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: gives a block back to the OS
+// Input  : &block -
+//-----------------------------------------------------------------------------
+void CArena::FreeBlock(Block_t& block)
+{
+	if (!block.pData)
+		return;
+
+#ifdef _WIN32
+	VirtualFree(block.pData, 0, MEM_RELEASE);
+#else
+	munmap(block.pData, block.nSize);
+#endif
+
+	block.pData = nullptr;
+	block.nSize = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: arena of the calling thread, lives as long as the thread
+//-----------------------------------------------------------------------------
+CArena& CArena::GetThreadArena()
+{
+	static thread_local CArena s_threadArena;
+	return s_threadArena;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: arena of a window slot of the calling thread's lump pipeline, the
+//			slots are created on first use and live as long as the thread
+//-----------------------------------------------------------------------------
+CArena& CArena::GetThreadSlotArena(const size_t nSlot)
+{
+	static thread_local std::vector<std::unique_ptr<CArena>> s_threadSlotArenas;
+
+	while (s_threadSlotArenas.size() <= nSlot)
+		s_threadSlotArenas.emplace_back(new CArena);
+
+	return *s_threadSlotArenas[nSlot];
+}
+
+ArenaAllocStats_t CArena::GetThreadAllocStats()
+{
+	return s_threadAllocStats;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CMapArenaScope constructor/destructor
+//-----------------------------------------------------------------------------
+CMapArenaScope::CMapArenaScope(const bool bUseHugePages, const size_t numSlots) : m_arena(CArena::GetThreadArena())
+{
+	m_arena.SetUseHugePages(bUseHugePages);
+	m_slots.resize(numSlots);
+
+	for (size_t i = 0; i < numSlots; i++)
+	{
+		m_slots[i] = &CArena::GetThreadSlotArena(i);
+		m_slots[i]->SetUseHugePages(bUseHugePages);
+	}
+}
+CMapArenaScope::~CMapArenaScope()
+{
+	m_arena.Reset();
+
+	for (CArena* const pSlot : m_slots)
+		pSlot->Reset();
+}
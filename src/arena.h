@@ -0,0 +1,88 @@
+#pragma once
+#include <mutex>
+#include <vector>
+
+// allocations made from arenas, see CArena::GetThreadAllocStats
+struct ArenaAllocStats_t
+{
+	uint64_t numAllocs;
+	uint64_t numBytes;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: bump allocator for buffers that share a lifetime
+//
+// Allocations are never freed one by one; everything is released at once by
+// Reset. The memory itself is kept for the next use (up to a limit), so
+// converting many lumps or maps in a row doesn't go back to the heap every
+// time.
+//
+// Allocating is thread safe. Each thread converting maps has its own arena
+// for the scratch buffers of a map, see CMapArenaScope; the lumps of a map
+// allocate from the arena of their pipeline window slot, which is reset as
+// soon as the lump is written.
+//-----------------------------------------------------------------------------
+class CArena
+{
+public:
+	CArena();
+	~CArena();
+
+	void* Alloc(const size_t nSize, const size_t nAlignment = 16);
+	template<typename T>
+	inline T* Alloc(const size_t nCount) { return reinterpret_cast<T*>(Alloc(nCount * sizeof(T), alignof(T) > 16 ? alignof(T) : 16)); }
+
+	// releases all allocations, must not be called while they are in use
+	void Reset();
+
+	// back new blocks with huge/large pages where the OS allows it
+	inline void SetUseHugePages(const bool bUseHugePages) { m_bUseHugePages = bUseHugePages; }
+
+	inline size_t GetBytesUsed() const { return m_nBytesUsed; }
+	inline size_t GetBytesReserved() const { return m_nBytesReserved; }
+
+	static CArena& GetThreadArena();
+	// the calling thread's arenas for the window slots of the lump pipeline,
+	// kept for the next map like the thread's arena
+	static CArena& GetThreadSlotArena(const size_t nSlot);
+	// the allocations the calling thread has made from any arena so far
+	static ArenaAllocStats_t GetThreadAllocStats();
+
+private:
+	struct Block_t
+	{
+		char* pData;
+		size_t nSize;
+		size_t nUsed;
+	};
+
+	bool AllocBlock(const size_t nMinSize, Block_t& block);
+	static void FreeBlock(Block_t& block);
+
+	std::mutex m_mutex;
+	std::vector<Block_t> m_blocks; // the last one is allocated from
+
+	size_t m_nBytesUsed;
+	size_t m_nBytesReserved;
+	size_t m_nPeakBytesUsed; // since the last Reset
+	size_t m_nNextBlockSize; // the next block is made large enough for the last use, see Reset
+	bool m_bUseHugePages;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: hands out the calling thread's arenas for the conversion of one map,
+//			and resets them once the map is done
+//-----------------------------------------------------------------------------
+class CMapArenaScope
+{
+public:
+	CMapArenaScope(const bool bUseHugePages, const size_t numSlots);
+	~CMapArenaScope();
+
+	inline CArena& Get() const { return m_arena; }
+	inline CArena& GetSlot(const size_t nSlot) const { return *m_slots[nSlot]; }
+
+private:
+	CArena& m_arena;
+	std::vector<CArena*> m_slots;
+};
@@ -8,9 +8,13 @@ CIOStream::CIOStream()
 {
 	m_nSize = 0;
 	m_nFlags = Mode_t::NONE;
+	m_nMapPos = 0;
 }
 CIOStream::CIOStream(const fs::path& svFileFullPath, int nFlags)
 {
+	m_nSize = 0;
+	m_nFlags = Mode_t::NONE;
+	m_nMapPos = 0;
 	Open(svFileFullPath, nFlags);
 }
 
@@ -39,7 +43,23 @@ bool CIOStream::Open(const fs::path& fsFilePath, int nFlags)
 	{
 		m_Stream.close();
 	}
-	m_Stream.open(fsFilePath, nFlags);
+	m_Mapping.Close();
+	m_nMapPos = 0;
+
+	if (nFlags & Mode_t::MMAP)
+	{
+		// mapped files are read in place and never go through the stream
+		if (!(nFlags & Mode_t::READ) || (nFlags & Mode_t::WRITE) || !m_Mapping.Open(fsFilePath))
+		{
+			m_nFlags = Mode_t::NONE;
+			return false;
+		}
+
+		m_nSize = std::streampos(std::streamoff(m_Mapping.GetSize()));
+		return true;
+	}
+
+	m_Stream.open(fsFilePath, std::ios::openmode(nFlags));
 	if (!m_Stream.is_open() || !m_Stream.good())
 	{
 		m_nFlags = Mode_t::NONE;
@@ -54,12 +74,41 @@ bool CIOStream::Open(const fs::path& fsFilePath, int nFlags)
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: maps a file of a listed directory, opened relative to its handle
+// Input  : &directory -
+//			&fileName - name of the file, without the directory
+//			nFlags - has to be READ | MMAP, streams can't be opened by handle
+// Output : true if operation is successful
+//-----------------------------------------------------------------------------
+bool CIOStream::Open(const CNativeDirectory& directory, const std::string& fileName, int nFlags)
+{
+	m_nFlags = nFlags;
+
+	if (m_Stream.is_open())
+	{
+		m_Stream.close();
+	}
+	m_Mapping.Close();
+	m_nMapPos = 0;
+
+	if (!(nFlags & Mode_t::MMAP) || !(nFlags & Mode_t::READ) || (nFlags & Mode_t::WRITE) || !m_Mapping.Open(directory, fileName))
+	{
+		m_nFlags = Mode_t::NONE;
+		return false;
+	}
+
+	m_nSize = std::streampos(std::streamoff(m_Mapping.GetSize()));
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: closes the stream
 //-----------------------------------------------------------------------------
 void CIOStream::Close()
 {
 	m_Stream.close();
+	m_Mapping.Close();
 }
 
 //-----------------------------------------------------------------------------
@@ -94,6 +143,9 @@ void CIOStream::ComputeFileSize()
 //-----------------------------------------------------------------------------
 std::streampos CIOStream::TellGet()
 {
+	if (IsMapped())
+		return std::streampos(std::streamoff(m_nMapPos));
+
 	return m_Stream.tellg();
 }
 std::streampos CIOStream::TellPut()
@@ -108,6 +160,12 @@ std::streampos CIOStream::TellPut()
 //-----------------------------------------------------------------------------
 void CIOStream::SeekGet(const std::streampos nOffset)
 {
+	if (IsMapped())
+	{
+		m_nMapPos = std::min(size_t(std::streamoff(nOffset)), size_t(m_Mapping.GetSize()));
+		return;
+	}
+
 	m_Stream.seekg(nOffset, std::ios::beg);
 }
 void CIOStream::SeekPut(const std::streampos nOffset)
@@ -117,7 +175,9 @@ void CIOStream::SeekPut(const std::streampos nOffset)
 void CIOStream::Seek(const std::streampos nOffset)
 {
 	SeekGet(nOffset);
-	SeekPut(nOffset);
+
+	if (!IsMapped())
+		SeekPut(nOffset);
 }
 
 //-----------------------------------------------------------------------------
@@ -144,6 +204,9 @@ const std::streampos CIOStream::GetSize() const
 //-----------------------------------------------------------------------------
 bool CIOStream::IsReadable()
 {
+	if (IsMapped())
+		return m_nMapPos < m_Mapping.GetSize();
+
 	if (!(m_nFlags & Mode_t::READ) || !m_Stream || m_Stream.eof())
 		return false;
 
@@ -168,9 +231,28 @@ bool CIOStream::IsWritable() const
 //-----------------------------------------------------------------------------
 bool CIOStream::IsEof() const
 {
+	if (IsMapped())
+		return m_nMapPos >= m_Mapping.GetSize();
+
 	return m_Stream.eof();
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: copies data from the current position of the file view
+// Input  : *pDst -
+//			nSize -
+//-----------------------------------------------------------------------------
+void CIOStream::ReadMapped(void* const pDst, const size_t nSize)
+{
+	const size_t nAvailable = size_t(m_Mapping.GetSize()) - m_nMapPos;
+	const size_t nCopySize = std::min(nSize, nAvailable);
+
+	if (nCopySize)
+		memcpy(pDst, m_Mapping.GetData() + m_nMapPos, nCopySize);
+
+	m_nMapPos += nCopySize;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: reads a string from the file and returns it
 // Input  : &svOut - 
@@ -178,6 +260,23 @@ bool CIOStream::IsEof() const
 //-----------------------------------------------------------------------------
 bool CIOStream::ReadString(std::string& svOut)
 {
+	if (IsMapped())
+	{
+		if (!IsReadable())
+			return false;
+
+		const char* const pStart = m_Mapping.GetData() + m_nMapPos;
+		const size_t nAvailable = size_t(m_Mapping.GetSize()) - m_nMapPos;
+
+		const char* const pEnd = reinterpret_cast<const char*>(memchr(pStart, '\0', nAvailable));
+		const size_t nLength = pEnd ? size_t(pEnd - pStart) : nAvailable;
+
+		svOut.append(pStart, nLength);
+		m_nMapPos += pEnd ? nLength + 1 : nLength;
+
+		return true;
+	}
+
 	if (IsReadable())
 	{
 		char c;
@@ -1,4 +1,5 @@
 #pragma once
+#include "nativefile.h"
 
 class CIOStream
 {
@@ -9,6 +10,7 @@ public:
 		READ = std::ios::in,
 		WRITE = std::ios::out,
 		BINARY = std::ios::binary,
+		MMAP = 1 << 24, // READ only; maps the file instead of streaming it, see GetMappedData
 	};
 
 	CIOStream();
@@ -16,6 +18,8 @@ public:
 	~CIOStream();
 
 	bool Open(const fs::path& fsFileFullPath, int nFlags);
+	// MMAP only, opens relative to the directory handle
+	bool Open(const CNativeDirectory& directory, const std::string& fileName, int nFlags);
 	void Close();
 	void Flush();
 
@@ -31,6 +35,9 @@ public:
 	const std::filebuf* GetData() const;
 	const std::streampos GetSize() const;
 
+	inline bool IsMapped() const { return (m_nFlags & Mode_t::MMAP) != 0; }
+	inline char* GetMappedData() const { return m_Mapping.GetData(); }
+
 	bool IsReadable();
 	bool IsWritable() const;
 
@@ -42,7 +49,9 @@ public:
 	template<typename T>
 	void Read(T& tValue)
 	{
-		if (IsReadable())
+		if (IsMapped())
+			ReadMapped(&tValue, sizeof(tValue));
+		else if (IsReadable())
 			m_Stream.read(reinterpret_cast<char*>(&tValue), sizeof(tValue));
 	}
 
@@ -52,13 +61,17 @@ public:
 	template<typename T>
 	void Read(T* tValue, const size_t nSize)
 	{
-		if (IsReadable())
+		if (IsMapped())
+			ReadMapped(tValue, nSize);
+		else if (IsReadable())
 			m_Stream.read(reinterpret_cast<char*>(tValue), nSize);
 	}
 	template<typename T>
 	void Read(T& tValue, const size_t nSize)
 	{
-		if (IsReadable())
+		if (IsMapped())
+			ReadMapped(&tValue, nSize);
+		else if (IsReadable())
 			m_Stream.read(reinterpret_cast<char*>(&tValue), nSize);
 	}
 
@@ -69,6 +82,11 @@ public:
 	T Read()
 	{
 		T value{};
+		if (IsMapped())
+		{
+			ReadMapped(&value, sizeof(value));
+			return value;
+		}
 		if (!IsReadable())
 			return value;
 
@@ -105,7 +123,11 @@ public:
 	bool WriteString(const std::string& svInput);
 
 private:
+	void ReadMapped(void* const pDst, const size_t nSize);
+
 	std::streampos  m_nSize;  // File size.
 	int             m_nFlags; // Stream flags.
 	std::fstream    m_Stream; // I/O stream.
+	CMappedFile     m_Mapping; // File view (MMAP mode).
+	size_t          m_nMapPos; // Read position in the view.
 };
@@ -2,58 +2,143 @@
 #include "versions.h"
 
 #include "binstream.h"
+#include "nativefile.h"
 #include "stltools.h"
 
 #include "rmem.h"
 #include "bspfile.h"
 #include "entity_partition.h"
+#include "threadpool.h"
+#include "iobatch.h"
+#include "lumpinventory.h"
+#include "arena.h"
+#include "outputset.h"
+#include "stats.h"
+#include "allocprofile.h"
+
+// size of the pieces entity partition files are read and converted in
+#define ENTITY_PARTITION_READ_SIZE (64 * 1024)
+
+// number of lumps opened together with async I/O, bounds the handles held open
+// per map
+#define LUMP_OPEN_BATCH_SIZE 32
+
+// bounds of the piece size transformed lumps are streamed in with -memcap
+#define STREAM_MIN_CHUNK_SIZE (64 * 1024)
+#define STREAM_MAX_CHUNK_SIZE (64 * 1024 * 1024)
+
+// memory a map needs besides its transformed lumps: header, lump jobs,
+// entity partition buffers and the first arena block
+#define CONVERT_BASE_MEMORY (8 * 1024 * 1024)
+
+// converts a whole entity partition or entities lump with CEntityPartitionMgr,
+// which CEntityPartitionStream has to match byte for byte; the result is
+// appended to output
+static bool ConvertEntityPartitionBuffered(const char* const data, const size_t size, const bool parseHeader, std::string& output)
+{
+	// the parser expects a terminated string, which the lump may lack
+	const std::string partitionBuffer(data, strnlen(data, size));
+
+	CEntityPartitionMgr partitionMgr;
+	if (!partitionMgr.ParseFromBuffer(partitionBuffer.c_str(), parseHeader) || !partitionMgr.ConvertEntityPartition())
+		return false;
+
+	partitionMgr.WriteToString(output);
+	return true;
+}
 
-bool FixEntityPartition(const std::string& partitionPath, const bool parseHeader)
+// readBuffer must hold ENTITY_PARTITION_READ_SIZE bytes, unless the partition
+// is buffered; the bytes read and written are added to stats
+static bool FixEntityPartition(const std::string& partitionPath, CNativeFile& inEntityPartition, const bool parseHeader, const bool buffered, char* const readBuffer, StatsCounters_t& stats)
 {
-	CIOStream inEntityPartition;
-	if (!inEntityPartition.Open(partitionPath, CIOStream::READ | CIOStream::BINARY))
+	TIME_SCOPE_DETAIL("FixEntityPartition", partitionPath);
+
+	const std::string newFile(COutputSet::GetNewPath(partitionPath));
+
+	CNativeFile outEntityPartition;
+	if (!outEntityPartition.Open(newFile, CNativeFile::WRITE))
 	{
-		printf("%s: Failed to open entity partition file: '%s'\n", __FUNCTION__, partitionPath.c_str());
+		Msg("%s: Failed to write entity partition file: '%s'\n", __FUNCTION__, newFile.c_str());
 		return false;
 	}
 
-	std::string partitionBuffer;
-	inEntityPartition.ReadString(partitionBuffer);
+	// unless buffered, the partition is converted while it is being read, so
+	// only one piece of it and the object currently being converted are ever
+	// held in memory
+	std::string outBuf;
 
-	CEntityPartitionMgr partitionMgr;
-	if (!partitionMgr.ParseFromBuffer(partitionBuffer.c_str(), parseHeader))
+	CEntityPartitionStream partitionStream(parseHeader);
+	bool converted = true;
+
+	if (buffered)
 	{
-		printf("%s: Failed to parse entity partition file: '%s'\n", __FUNCTION__, partitionPath.c_str());
-		return false;
+		std::string partitionBuffer(size_t(inEntityPartition.GetSize()), '\0');
+		const size_t numRead = inEntityPartition.Read(partitionBuffer.data(), partitionBuffer.size());
+
+		stats.bytesRead += numRead;
+		converted = numRead == partitionBuffer.size() && ConvertEntityPartitionBuffered(partitionBuffer.data(), numRead, parseHeader, outBuf);
 	}
 
-	const std::string newFile(partitionPath + ".new");
+	while (!buffered && !partitionStream.IsDone())
+	{
+		const size_t numRead = inEntityPartition.Read(readBuffer, ENTITY_PARTITION_READ_SIZE);
+
+		if (!numRead)
+			break;
+
+		stats.bytesRead += numRead;
+		outBuf.clear();
+
+		if (!partitionStream.Process(readBuffer, numRead, outBuf) || !outEntityPartition.Write(outBuf.data(), outBuf.size()))
+		{
+			converted = false;
+			break;
+		}
+
+		stats.bytesWritten += outBuf.size();
+	}
 
-	if (!partitionMgr.ConvertEntityPartition())
+	if (converted && !buffered)
 	{
-		printf("%s: Failed to convert entity partition file: '%s'\n", __FUNCTION__, newFile.c_str());
-		return false;
+		outBuf.clear();
+		converted = partitionStream.Finish(outBuf);
 	}
 
-	if (!partitionMgr.Write(newFile.c_str()))
+	// Entity partition files must always end with a '\0'!!!
+	outBuf += '\0';
+
+	if (!converted || !outEntityPartition.Write(outBuf.data(), outBuf.size()))
 	{
-		printf("%s: Failed to write entity partition file: '%s'\n", __FUNCTION__, newFile.c_str());
+		Msg("%s: Failed to convert entity partition file: '%s'\n", __FUNCTION__, partitionPath.c_str());
+
+		outEntityPartition.Close();
+		std::filesystem::remove(newFile);
+
 		return false;
 	}
 
-	printf("Writing new entity partition file: %s\n", partitionPath.c_str());
+	stats.bytesWritten += outBuf.size();
+
+	Msg("Writing new entity partition file: %s\n", partitionPath.c_str());
 	return true;
 }
 
 
-bool GetEntityPartitionNames(const std::string& bspPath, std::vector<std::string>& vec)
+bool GetEntityPartitionNames(const std::string& bspPath, std::vector<std::string>& vec, const CLumpInventory* const pInventory)
 {
-	const std::string entityPartitionLump = Format("%s.%.4X.bsp_lump", bspPath.c_str(), lumptype_t::LUMP_ENTITY_PARTITIONS);
+	TIME_SCOPE("GetEntityPartitionNames");
+
+	const CLumpInventory::Entry_t* const pEntry = pInventory && pInventory->IsValid() ? pInventory->FindLump(LUMP_ENTITY_PARTITIONS) : nullptr;
 	CIOStream read;
 
-	if (!read.Open(entityPartitionLump, CIOStream::READ | CIOStream::BINARY))
+	// not listed, the path based open fails if it's really missing
+	const bool opened = pEntry
+		? read.Open(pInventory->GetDirectory(), pEntry->name, CIOStream::READ | CIOStream::BINARY | CIOStream::MMAP)
+		: read.Open(Format("%s.%.4X.bsp_lump", bspPath.c_str(), lumptype_t::LUMP_ENTITY_PARTITIONS), CIOStream::READ | CIOStream::BINARY);
+
+	if (!opened)
 	{
-		printf("Failed to open entity partition lump\n");
+		Msg("Failed to open entity partition lump\n");
 		return false;
 	}
 
@@ -62,7 +147,7 @@ bool GetEntityPartitionNames(const std::string& bspPath, std::vector<std::string
 
 	if (ep.ident != dentitypartitionheader_t::VERSION)
 	{
-		printf("Unrecognized header in Entity Partition lump in bsp; ident=%hd, expected=%hd\n",
+		Msg("Unrecognized header in Entity Partition lump in bsp; ident=%hd, expected=%hd\n",
 			ep.ident, dentitypartitionheader_t::VERSION);
 		return false;
 	}
@@ -80,38 +165,167 @@ bool GetEntityPartitionNames(const std::string& bspPath, std::vector<std::string
 	return false;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: converts the entity partition files of a map on g_pThreadPool
+//
+// Each partition is converted by its own task, concurrently with the other
+// partitions and with the lump processing in ConvertBSP. A partition that fails
+// doesn't affect the others; every task buffers its own messages, which are
+// printed in partition order by Finish.
+//-----------------------------------------------------------------------------
+class CEntityPartitionFixer
+{
+public:
+	CEntityPartitionFixer() : m_pInventory(nullptr), m_pArena(nullptr), m_pOutputs(nullptr), m_pPool(nullptr), m_bBuffered(false) {}
+	~CEntityPartitionFixer() { Wait(); }
+
+	// the inventory, arena and output set have to outlive the fixer
+	void Start(const std::string& bspPath, const CLumpInventory& inventory, CArena& arena, COutputSet& outputs, const bool bBuffered);
+	// the partitions are added to pStats if set
+	void Finish(MapStats_t* const pStats);
+
+private:
+	struct Partition_t
+	{
+		std::string path;
+		const CLumpInventory::Entry_t* pEntry; // nullptr if not in the inventory
+		std::string output;
+		StatsCounters_t stats;
+		std::exception_ptr error; // thrown on the pool, rethrown by Finish
+	};
+
+	void Wait();
+	void Fix(Partition_t& partition) const;
+
+	std::vector<Partition_t> m_partitions; // not resized while tasks are running
+	const CLumpInventory* m_pInventory;
+	CArena* m_pArena;
+	COutputSet* m_pOutputs;
+	CThreadPool* m_pPool;
+	CTaskGroup m_group;
+	bool m_bBuffered; // see ConvertOptions_t::bufferPartitions
+};
+
 // newer versions of the game have an extra field in the BVH header, this field
 // has to be removed in order for BVH to function correctly. decode all *coll#
 // base64 strings, remove the field, re-encode the data.
 //
 // NOTE: if additional changes are found or made in the entity partitions,
 // such as renamed keys or header changes, perform the conversion here!
-void FixEntityPartitions(const std::string& bspPath)
+void CEntityPartitionFixer::Start(const std::string& bspPath, const CLumpInventory& inventory, CArena& arena, COutputSet& outputs, const bool bBuffered)
 {
 	const std::string pathNoExtension = RemoveExtension(bspPath);
 	std::vector<std::string> entityPartitionNames;
 
-	if (GetEntityPartitionNames(bspPath, entityPartitionNames))
+	if (!GetEntityPartitionNames(bspPath, entityPartitionNames, &inventory))
+		return;
+
+	m_partitions.resize(entityPartitionNames.size());
+
+	for (size_t i = 0; i < entityPartitionNames.size(); i++)
 	{
-		for (const std::string& name : entityPartitionNames)
+		m_partitions[i].path = Format("%s_%s.ent", pathNoExtension.c_str(), entityPartitionNames[i].c_str());
+		m_partitions[i].pEntry = inventory.IsValid() ? inventory.FindEntityPartition(entityPartitionNames[i]) : nullptr;
+	}
+
+	m_pInventory = &inventory;
+	m_pArena = &arena;
+	m_pOutputs = &outputs;
+	m_pPool = g_pThreadPool;
+	m_bBuffered = bBuffered;
+
+	if (!m_pPool)
+	{
+		for (Partition_t& partition : m_partitions)
+			Fix(partition);
+
+		return;
+	}
+
+	for (Partition_t& partition : m_partitions)
+	{
+		m_pPool->Submit(m_group, [this, &partition]()
 		{
-			const std::string partitionPath = Format("%s_%s.ent", pathNoExtension.c_str(), name.c_str());
-			FixEntityPartition(partitionPath, true);
-		}
+			CScopedMsgBuffer msgBuffer(&partition.output);
+
+			try
+			{
+				Fix(partition);
+			}
+			catch (...)
+			{
+				partition.error = std::current_exception();
+			}
+		});
 	}
 }
 
-void WriteNewLump(const std::string& lumpPath, const char* const lumpData, const size_t lumpSize)
+void CEntityPartitionFixer::Fix(Partition_t& partition) const
 {
-	const std::string newLumpPath = lumpPath + ".new";
+	CStatsScope statsScope(partition.stats);
+	CNativeFile inEntityPartition;
+
+	// not listed, the path based open fails if it's really missing
+	const bool opened = partition.pEntry
+		? m_pInventory->OpenFile(*partition.pEntry, inEntityPartition, CNativeFile::READ)
+		: inEntityPartition.Open(partition.path, CNativeFile::READ);
+
+	if (!opened)
+	{
+		Msg("%s: Failed to open entity partition file: '%s'\n", __FUNCTION__, partition.path.c_str());
+		return;
+	}
+
+	partition.stats.count = 1;
 
-	printf("Writing new lump to: \"%s\" size: %zu\n", newLumpPath.c_str(), lumpSize);
+	// a partition that failed has been removed again, the map is committed without it
+	char* const readBuffer = m_bBuffered ? nullptr : m_pArena->Alloc<char>(ENTITY_PARTITION_READ_SIZE);
+
+	if (FixEntityPartition(partition.path, inEntityPartition, true, m_bBuffered, readBuffer, partition.stats))
+		m_pOutputs->Add(partition.path);
+}
+
+void CEntityPartitionFixer::Wait()
+{
+	if (m_pPool)
+	{
+		m_pPool->Wait(m_group);
+		m_pPool = nullptr;
+	}
+}
+
+void CEntityPartitionFixer::Finish(MapStats_t* const pStats)
+{
+	Wait();
+
+	for (const Partition_t& partition : m_partitions)
+	{
+		Msg("%s", partition.output.c_str());
+
+		if (partition.error)
+			std::rethrow_exception(partition.error);
+
+		if (pStats && partition.stats.count)
+			pStats->entityPartitions.Add(partition.stats, partition.stats.bytesRead);
+	}
+
+	m_partitions.clear();
+}
+
+void WriteNewLump(const std::string& lumpPath, const char* const lumpData, const size_t lumpSize, COutputSet& outputs)
+{
+	const std::string newLumpPath = COutputSet::GetNewPath(lumpPath);
+
+	Msg("Writing new lump to: \"%s\" size: %zu\n", newLumpPath.c_str(), lumpSize);
 
 	CIOStream outGameProbes;
 	if (outGameProbes.Open(newLumpPath, CIOStream::WRITE | CIOStream::BINARY))
+	{
+		outputs.Add(lumpPath);
 		outGameProbes.Write(lumpData, lumpSize);
+	}
 	else
-		Error("Failed to open file for writing: %s\n", newLumpPath.c_str());
+		ConvertError("Failed to open file for writing: %s\n", newLumpPath.c_str());
 }
 
 // gamelumps have an absolute file offset to their data which needs to be updated to their new file offset
@@ -120,7 +334,7 @@ void FixGameLumpOffset(rmem& lumpBuf, const int nextLumpWriteOffset, const bool
 	const int numGameLumps = lumpBuf.read<int>();
 
 	if (numGameLumps != 1)
-		Error("Expected 1 game lump but found %i\n", numGameLumps);
+		ConvertError("Expected 1 game lump but found %i\n", numGameLumps);
 
 	r5::dgamelump_t* pGameLump = lumpBuf.get<r5::dgamelump_t>();
 
@@ -154,12 +368,568 @@ void FixLightmapRTLSize(BSPHeader_t* pHdr, const bool isPacked)
 	}
 }
 
+// returns whether the lump handler in ConvertBSP modifies the lump's data; keep
+// this in sync with the switch in there! lumps that aren't transformed are only
+// read from disk when they have to be packed into the bsp
+static bool LumpNeedsTransform(const int lumpIdx, const int version, const bool packAllLumps)
+{
+	switch (lumpIdx)
+	{
+	case LUMP_ENTITIES:
+		return version >= 48;
+	case LUMP_GAME_LUMP:
+		return !packAllLumps;
+	case LUMP_LIGHTPROBES:
+		return version >= 51;
+	default:
+		return false;
+	}
+}
+
+// copies an unmodified lump straight from its .bsp_lump file into the packed
+// bsp; if the lump is larger than its file (see FixLightmapRTLSize), the rest
+// is padded with null bytes
+static bool WritePackedLump(CNativeFile& out, CNativeFile& lumpIn, const size_t lumpSize)
+{
+	const size_t copySize = std::min(lumpSize, size_t(lumpIn.GetSize()));
+
+	if (!CopyFileRange(out, lumpIn, copySize))
+		return false;
+
+	static const char zeros[512] = {};
+
+	for (size_t padSize = lumpSize - copySize; padSize; )
+	{
+		const size_t chunkSize = std::min(padSize, sizeof(zeros));
+
+		if (!out.Write(zeros, chunkSize))
+			return false;
+
+		padSize -= chunkSize;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: a lump on its way through the ConvertBSP pipeline; LoadLump prepares
+//			it on the pool, after which ConvertBSP writes the lumps in order
+//-----------------------------------------------------------------------------
+struct LumpJob_t
+{
+	LumpJob_t() : index(0), fileLen(0), pInventory(nullptr), pEntry(nullptr), statDone(false), exists(false), fileSize(0), size(0), loaded(false), streamChunkSize(0), streamed(false), bufferPartitions(false), pArena(nullptr), pOutputs(nullptr), data(nullptr), pOut(nullptr), writeOffset(0), packedSize(0), written(false) {}
+
+	inline void Release()
+	{
+		file.Close();
+		mapping.Close();
+		data = nullptr;
+
+		// the next lump through this window slot reuses the memory
+		if (pArena)
+			pArena->Reset();
+	}
+
+	int index;
+	int fileLen; // size in the bsp header
+	std::string path;
+
+	// the lump's file if the map directory could be listed, it's opened
+	// relative to the directory then
+	const CLumpInventory* pInventory;
+	const CLumpInventory::Entry_t* pEntry;
+
+	// stat of the lump file, done by StatLump unless it is known up front
+	bool statDone;
+	bool exists;
+	uint64_t fileSize;
+
+	size_t size; // size of the lump data to write
+	bool loaded; // false if the lump has to be skipped
+
+	// pack mode, if set transformed lumps are converted in pieces of this size
+	// while they are written instead of being loaded as a whole
+	size_t streamChunkSize;
+	bool streamed;
+
+	bool bufferPartitions; // see ConvertOptions_t
+
+	StatsCounters_t stats; // of LoadLump and the write of the lump
+
+	CNativeFile file; // untransformed lumps are copied from file to file when packing
+	CIOStream mapping;
+
+	CArena* pArena; // of the job's window slot, buffers of transformed lumps come from it
+	COutputSet* pOutputs; // unpacked mode, transformed lumps are written as new files
+	char* data; // transformed lump data, points into mapping or pArena
+
+	// parallel write mode; LoadLump writes the lump into its precomputed
+	// place in pOut itself
+	CNativeFile* pOut;
+	uint64_t writeOffset;
+	size_t packedSize;
+	bool written;
+
+	std::string output; // messages, printed once the lump is written
+	std::exception_ptr error; // thrown by LoadLump on the pool, rethrown by the writer
+	CTaskGroup group;
+};
+
+// stats the lump file, this also tells us whether it actually exists
+static bool StatLump(LumpJob_t& job)
+{
+	if (!job.statDone)
+	{
+		std::error_code ec;
+		job.fileSize = uint64_t(std::filesystem::file_size(job.path, ec));
+		job.exists = !ec;
+		job.statDone = true;
+	}
+
+	return job.exists;
+}
+
+// opens the lump file for reading
+static bool OpenLumpFile(const LumpJob_t& job, CNativeFile& file)
+{
+	if (job.pEntry)
+		return job.pInventory->OpenFile(*job.pEntry, file, CNativeFile::READ);
+
+	return file.Open(job.path, CNativeFile::READ);
+}
+
+// size a lump will have in the packed bsp, computed from the size of its file
+// before it is loaded; keep this in sync with the transforms in LoadLump!
+static bool GetPackedLumpSize(LumpJob_t& job, const int currentVersion, size_t& packedSize)
+{
+	if (!StatLump(job))
+		return false;
+
+	const size_t fileSize = size_t(job.fileSize);
+	packedSize = fileSize;
+
+	switch (job.index)
+	{
+	case LUMP_LIGHTPROBES:
+	{
+		if (currentVersion >= 51)
+			packedSize = (fileSize / sizeof(r5::v51::dlightprobe_t)) * sizeof(dlightprobe_t);
+
+		break;
+	}
+	case LUMP_LIGHTMAP_DATA_REAL_TIME_LIGHTS:
+	{
+		packedSize = size_t(job.fileLen);
+		break;
+	}
+	}
+
+	return true;
+}
+
+// writes a transformed lump to out at outOffset in pieces of streamChunkSize,
+// so neither the lump nor its converted form is held in memory as a whole;
+// keep the conversions in sync with the ones in LoadLump!
+static bool WriteStreamedLump(LumpJob_t& job, CNativeFile& out, const uint64_t outOffset)
+{
+	TIME_SCOPE_DETAIL("WriteStreamedLump", job.path);
+
+	const size_t chunkSize = job.streamChunkSize;
+	const size_t lumpSize = size_t(job.fileSize);
+
+	switch (job.index)
+	{
+	case LUMP_ENTITIES:
+	{
+		char* const readBuffer = job.pArena->Alloc<char>(chunkSize);
+
+		CEntityPartitionStream partitionStream(false);
+		std::string outBuf;
+
+		size_t numRead = 0;
+		size_t numWritten = 0;
+
+		// the lump keeps its size, the converted data is cut off where it
+		// would exceed it (see LoadLump)
+		const auto writeOutput = [&]()
+		{
+			const size_t numToWrite = std::min(outBuf.size(), lumpSize - numWritten);
+
+			if (numToWrite && !out.WriteAt(outBuf.data(), numToWrite, outOffset + numWritten))
+				return false;
+
+			numWritten += numToWrite;
+			outBuf.clear();
+
+			return true;
+		};
+
+		bool converted = true;
+
+		while (converted && numRead < lumpSize && !partitionStream.IsDone())
+		{
+			const size_t numChunk = job.file.ReadAt(readBuffer, std::min(chunkSize, lumpSize - numRead), numRead);
+			numRead += numChunk;
+
+			converted = numChunk && partitionStream.Process(readBuffer, numChunk, outBuf) && writeOutput();
+		}
+
+		if (!converted || !partitionStream.Finish(outBuf) || !writeOutput())
+		{
+			Msg("%s: Failed to convert \"%s\"\n", __FUNCTION__, "LUMP_ENTITIES");
+			numWritten = 0; // put the original lump back
+		}
+
+		// whatever the converted data didn't cover stays as it was
+		return CopyFileRangeAt(out, outOffset + numWritten, job.file, numWritten, lumpSize - numWritten);
+	}
+	case LUMP_LIGHTPROBES:
+	{
+		const size_t numLightProbes = lumpSize / sizeof(r5::v51::dlightprobe_t);
+		const size_t probesPerChunk = std::max(size_t(1), chunkSize / sizeof(dlightprobe_t));
+
+		char* const readBuffer = job.pArena->Alloc<char>(probesPerChunk * sizeof(r5::v51::dlightprobe_t));
+		char* const writeBuffer = job.pArena->Alloc<char>(probesPerChunk * sizeof(dlightprobe_t));
+
+		for (size_t probe = 0; probe < numLightProbes; probe += probesPerChunk)
+		{
+			const size_t numProbes = std::min(probesPerChunk, numLightProbes - probe);
+			const size_t readSize = numProbes * sizeof(r5::v51::dlightprobe_t);
+
+			if (job.file.ReadAt(readBuffer, readSize, probe * sizeof(r5::v51::dlightprobe_t)) != readSize)
+				return false;
+
+			ExpandLightProbes_v51(readBuffer, writeBuffer, numProbes);
+
+			if (!out.WriteAt(writeBuffer, numProbes * sizeof(dlightprobe_t), outOffset + probe * sizeof(dlightprobe_t)))
+				return false;
+		}
+
+		return true;
+	}
+	default:
+		assert(0);
+		return false;
+	}
+}
+
+// stats, maps and transforms a lump, only touches the job so it can run
+// concurrently with other lumps; untransformed lumps are only opened when they
+// have to be packed into the bsp
+static void LoadLump(LumpJob_t& job, const int currentVersion, const bool packAllLumps)
+{
+	CScopedMsgBuffer msgBuffer(&job.output);
+	CStatsScope statsScope(job.stats);
+	CAllocLumpScope allocScope(job.index);
+	TIME_SCOPE_DETAIL("LoadLump", job.path);
+
+	const int i = job.index;
+	const std::string& lumpPath = job.path;
+
+	if (!StatLump(job))
+	{
+		Msg("Lump %04x file not found: %s\n", i, lumpPath.c_str());
+		return;
+	}
+
+	size_t lumpSize = size_t(job.fileSize);
+
+	if (int(lumpSize) != job.fileLen)
+		Msg("Lump %04x file size mismatch (file %i, bsp %i)\n", i, int(lumpSize), job.fileLen);
+
+	// only map the lump if it gets transformed, the header rewrite of
+	// untouched lumps just needs the size and packing copies them from
+	// file to file without going through memory
+	const bool needsTransform = LumpNeedsTransform(i, currentVersion, packAllLumps) && lumpSize;
+
+	if (needsTransform && packAllLumps && job.streamChunkSize)
+	{
+		// converted piece by piece while being written, see WriteStreamedLump
+		if (!job.file.IsOpen() && !OpenLumpFile(job, job.file))
+		{
+			Msg("Failed to open lump \"%s\"\n", lumpPath.c_str());
+			return;
+		}
+
+		GetPackedLumpSize(job, currentVersion, job.size);
+		job.streamed = true;
+		job.loaded = true;
+
+		if (job.pOut)
+		{
+			job.written = WriteStreamedLump(job, *job.pOut, job.writeOffset);
+			job.stats.bytesRead = lumpSize;
+			job.stats.bytesWritten = job.written ? job.size : 0;
+			job.Release();
+		}
+
+		return;
+	}
+
+	char* lumpData = nullptr;
+
+	if (needsTransform)
+	{
+		const bool mapped = job.pEntry
+			? job.mapping.Open(job.pInventory->GetDirectory(), job.pEntry->name, CIOStream::READ | CIOStream::BINARY | CIOStream::MMAP)
+			: job.mapping.Open(lumpPath, CIOStream::READ | CIOStream::BINARY | CIOStream::MMAP);
+
+		if (!mapped)
+		{
+			Msg("Failed to open lump \"%s\"\n", lumpPath.c_str());
+			return;
+		}
+
+		lumpData = job.mapping.GetMappedData();
+	}
+	else if (packAllLumps && !job.file.IsOpen() && !OpenLumpFile(job, job.file))
+	{
+		Msg("Failed to open lump \"%s\"\n", lumpPath.c_str());
+		return;
+	}
+
+	switch (i)
+	{
+	case LUMP_ENTITIES:
+	{
+		TIME_SCOPE("ConvertEntitiesLump");
+
+		if (currentVersion >= 48)
+		{
+			CEntityPartitionStream partitionStream(false);
+			std::string outBuf;
+
+			// the lump may lack its trailing '\0', the stream stops at
+			// whichever comes first
+			const bool converted = job.bufferPartitions
+				? ConvertEntityPartitionBuffered(lumpData, lumpSize, false, outBuf)
+				: partitionStream.Process(lumpData, lumpSize, outBuf) && partitionStream.Finish(outBuf);
+
+			if (converted)
+			{
+				// Copy into existing buffer; the sizes won't change
+				// as the conversion process removes 8 bytes and pads
+				// them elsewhere for alignment reasons (as of the RPak
+				// v12.1 change).
+				outBuf.copy(lumpData, std::min(outBuf.size(), lumpSize));
+
+				if (!packAllLumps)
+					WriteNewLump(lumpPath, lumpData, lumpSize, *job.pOutputs);
+			}
+			else
+			{
+				Msg("%s: Failed to convert \"%s\"\n", __FUNCTION__, "LUMP_ENTITIES");
+				assert(0);
+			}
+		}
+
+		break;
+	}
+	case LUMP_GAME_LUMP:
+	{
+		TIME_SCOPE("FixGameLump");
+
+		if (!packAllLumps)
+		{
+			rmem lumpBuf(lumpData);
+
+			// the offset is only used for packed bsps, which don't have
+			// their game lump transformed
+			FixGameLumpOffset(lumpBuf, 0, packAllLumps);
+			WriteNewLump(lumpPath, lumpData, lumpSize, *job.pOutputs);
+		}
+
+		break;
+	}
+	case LUMP_LIGHTPROBES:
+	{
+		TIME_SCOPE("ConvertLightProbes");
+
+		if (currentVersion >= 51)
+		{
+			rmem lumpBuf(lumpData);
+			ConvertLightProbes_v51(lumpBuf, lumpData, lumpSize, *job.pArena);
+
+			if (!packAllLumps)
+				WriteNewLump(lumpPath, lumpData, lumpSize, *job.pOutputs);
+		}
+
+		break;
+	}
+	}
+
+	job.data = lumpData;
+	job.size = lumpSize;
+	job.loaded = true;
+
+	// untransformed lumps aren't read unless they are packed
+	if (needsTransform || packAllLumps)
+		job.stats.bytesRead = job.fileSize;
+
+	if (needsTransform && !packAllLumps)
+		job.stats.bytesWritten = lumpSize;
+
+	if (job.pOut)
+	{
+		TIME_SCOPE("WriteLump");
+
+		if (lumpData)
+		{
+			if (lumpSize == job.packedSize)
+				job.written = job.pOut->WriteAt(lumpData, lumpSize, job.writeOffset);
+			else
+				Msg("Lump %04x size %zu doesn't match its precomputed size %zu\n", i, lumpSize, job.packedSize);
+		}
+		else
+		{
+			// the file is preallocated with zeros, so a lump that is larger
+			// than its file (see FixLightmapRTLSize) is already padded
+			job.written = CopyFileRangeAt(*job.pOut, job.writeOffset, job.file, 0, std::min(lumpSize, job.packedSize));
+		}
+
+		job.stats.bytesWritten = job.written ? job.packedSize : 0;
+		job.Release();
+	}
+}
+
+// starts readahead of a lump that is about to be loaded, only touches the job
+// so it must not have been submitted yet; keepOpen is false for lumps too far
+// ahead to hold on to their file, see LUMP_OPEN_BATCH_SIZE
+static void PrefetchLump(LumpJob_t& job, const int currentVersion, const bool packAllLumps, const bool keepOpen)
+{
+	if (job.statDone && !job.exists)
+		return;
+
+	if (packAllLumps && (keepOpen || job.file.IsOpen()))
+	{
+		// keep it open, LoadLump needs it anyway unless the lump gets mapped
+		if (job.file.IsOpen() || OpenLumpFile(job, job.file))
+			job.file.Prefetch();
+	}
+	else if (packAllLumps || LumpNeedsTransform(job.index, currentVersion, packAllLumps))
+	{
+		// the readahead outlives the handle
+		CNativeFile lumpIn;
+
+		if (OpenLumpFile(job, lumpIn))
+			lumpIn.Prefetch();
+	}
+}
+
+// opens the untransformed lumps in [begin, end) for packing in a single batch,
+// the ones that fail are retried and reported by LoadLump; returns end
+static size_t OpenLumps(std::vector<LumpJob_t>& jobs, const size_t begin, const size_t end, const int currentVersion)
+{
+	TIME_SCOPE("OpenLumps");
+
+	CIOBatch openBatch(true);
+
+	for (size_t k = begin; k < end; k++)
+	{
+		LumpJob_t& job = jobs[k];
+
+		if (job.exists && !job.file.IsOpen() && !(LumpNeedsTransform(job.index, currentVersion, true) && job.fileSize))
+		{
+			if (job.pEntry)
+				openBatch.AddOpen(job.pInventory->GetDirectory(), job.pEntry->name, job.file);
+			else
+				openBatch.AddOpen(job.path, job.file);
+		}
+	}
+
+	openBatch.Submit();
+	return end;
+}
+
+// with a memory cap the transformed lumps are streamed when packing; two of
+// them can be in flight at once, each holding an input and an output piece
+static size_t GetStreamChunkSize(const ConvertOptions_t& options)
+{
+	if (!options.packAllLumps || !options.memoryCap)
+		return 0;
+
+	return std::clamp(options.memoryCap / 8, size_t(STREAM_MIN_CHUNK_SIZE), size_t(STREAM_MAX_CHUNK_SIZE));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: estimates the peak memory ConvertBSP needs for a map, from the lump
+//			sizes in its header; keep this in sync with LoadLump!
+// Input  : *bspBuf - at least the header of the bsp
+//			&options -
+// Output : estimated bytes
+//-----------------------------------------------------------------------------
+size_t EstimateConvertMemory(const char* const bspBuf, const ConvertOptions_t& options)
+{
+	const BSPHeader_t* const pHdr = reinterpret_cast<const BSPHeader_t*>(bspBuf);
+	size_t estimate = CONVERT_BASE_MEMORY;
+
+	if (pHdr->ident != 'PSBr')
+		return estimate;
+
+	const size_t streamChunkSize = GetStreamChunkSize(options);
+	const int numLumps = std::min(pHdr->lastLump + 1, int(LUMP_COUNT));
+
+	for (int i = 0; i < numLumps; i++)
+	{
+		const size_t lumpSize = size_t(std::max(pHdr->lumps[i].filelen, 0));
+
+		// untransformed lumps are copied from file to file, or not touched at all
+		if (!lumpSize || !LumpNeedsTransform(i, pHdr->version, options.packAllLumps))
+			continue;
+
+		if (streamChunkSize)
+		{
+			estimate += 2 * std::min(lumpSize, streamChunkSize);
+			continue;
+		}
+
+		switch (i)
+		{
+		case LUMP_ENTITIES:
+		{
+			// the mapped lump plus the converted copy
+			estimate += 2 * lumpSize;
+			break;
+		}
+		case LUMP_LIGHTPROBES:
+		{
+			// the mapped lump plus the expanded copy
+			estimate += lumpSize + (lumpSize / sizeof(r5::v51::dlightprobe_t)) * sizeof(dlightprobe_t);
+			break;
+		}
+		default:
+		{
+			// patched in the mapping
+			estimate += lumpSize;
+			break;
+		}
+		}
+	}
+
+	return estimate;
+}
+
 // convert BSP from incompatible versions to version 47.
-void ConvertBSP(const std::string& bspPath, char* const bspBuf, const bool packAllLumps)
+void ConvertBSP(const std::string& bspPath, char* const bspBuf, const ConvertOptions_t& options, COutputSet& outputs, MapStats_t* const pStats, const CLumpInventory* const pInventory)
 {
-	CIOStream out;
-	if (!out.Open(bspPath + ".new", CIOStream::WRITE | CIOStream::BINARY))
-		Error("Failed to write output BSP file; insufficient rights?\n");
+	const bool packAllLumps = options.packAllLumps;
+	const bool parallelWrite = packAllLumps && options.parallelWrite;
+
+	// lumps are loaded and transformed ahead of the writer on the pool, the
+	// window limits how many of them are held in memory at once
+	CThreadPool* const pPool = g_pThreadPool;
+	const size_t pipelineDepth = pPool ? pPool->GetNumThreads() * 2 + 1 : 1;
+
+	// scratch buffers of the map come from here, released at once when it's
+	// done; lump buffers come from the arenas of the pipeline's window slots
+	CMapArenaScope arenaScope(options.hugePages, pipelineDepth);
+	CArena& arena = arenaScope.Get();
+
+	CNativeFile out;
+	if (!out.Open(COutputSet::GetNewPath(bspPath), CNativeFile::WRITE))
+		ConvertError("Failed to write output BSP file; insufficient rights?\n");
+
+	outputs.Add(bspPath);
 
 	if(packAllLumps) // seek to end of header as we write lump data past it
 		out.Seek(sizeof(BSPHeader_t));
@@ -168,7 +938,7 @@ void ConvertBSP(const std::string& bspPath, char* const bspBuf, const bool packA
 	BSPHeader_t* const pHdr = buf.get<BSPHeader_t>();
 
 	if (pHdr->ident != 'PSBr')
-		Error("Input file had invalid magic (expected \"rBSP\")\n");
+		ConvertError("Input file had invalid magic (expected \"rBSP\")\n");
 
 	// we shouldnt need to access these later so we can get away with modifying
 	// these vars here for convenience
@@ -177,149 +947,268 @@ void ConvertBSP(const std::string& bspPath, char* const bspBuf, const bool packA
 	pHdr->version = BSPVERSION;
 	pHdr->flags = 0;
 
+	if (pStats)
+		pStats->version = currentVersion;
+
+	// list the map's files once, instead of probing every lump on its own
+	CLumpInventory localInventory;
+
+	if (!pInventory)
+		localInventory.Scan(bspPath);
+
+	const CLumpInventory& inventory = pInventory ? *pInventory : localInventory;
+
+	// entity partitions are converted in the background while the lumps are processed
+	CEntityPartitionFixer partitionFixer;
+
 	if (currentVersion >= 48)
-		FixEntityPartitions(bspPath);
+		partitionFixer.Start(bspPath, inventory, arena, outputs, options.bufferPartitions);
 
 	const int numLumps = pHdr->lastLump + 1;
-	std::vector<lump_t> lumps(numLumps);
+	const size_t streamChunkSize = GetStreamChunkSize(options);
 
-	// copy lump info from header into vector so it can be sorted by offset
-	memcpy_s(lumps.data(), numLumps * sizeof(lump_t), &pHdr->lumps, numLumps * sizeof(lump_t));
+	std::vector<LumpJob_t> jobs(numLumps);
+	size_t numJobs = 0;
 
-	// write lump index into uncompLen so that it can be accessed after sorting
-	// uncompLen should be unused (and have no existing values from file)
-	// leaving this var set isn't a problem because the "lumps" vector isn't written to file
-	for (int i = 0; i < lumps.size(); ++i)
+	// turn the lump table into jobs, in the order the lumps are laid out
 	{
-		lumps[i].uncompLen = i;
-	}
+		TIME_SCOPE("ParseHeader");
 
-	// sort by lump offset
-	std::sort(lumps.begin(), lumps.end());
+		std::vector<lump_t> lumps(numLumps);
 
-	int nextLumpWriteOffset = sizeof(BSPHeader_t);
+		// copy lump info from header into vector so it can be sorted by offset
+		memcpy_s(lumps.data(), numLumps * sizeof(lump_t), &pHdr->lumps, numLumps * sizeof(lump_t));
+
+		// write lump index into uncompLen so that it can be accessed after sorting
+		// uncompLen should be unused (and have no existing values from file)
+		// leaving this var set isn't a problem because the "lumps" vector isn't written to file
+		for (int i = 0; i < lumps.size(); ++i)
+		{
+			lumps[i].uncompLen = i;
+		}
+
+		// sort by lump offset
+		std::sort(lumps.begin(), lumps.end());
 
-	for (const lump_t& lump : lumps)
+		for (const lump_t& lump : lumps)
+		{
+			if (lump.filelen == 0)
+				continue;
+
+			LumpJob_t& job = jobs[numJobs++];
+
+			// retrieve lump index from temp storage in uncompLen
+			job.index = lump.uncompLen;
+			job.fileLen = lump.filelen;
+			job.pOutputs = &outputs;
+			job.streamChunkSize = streamChunkSize;
+			job.bufferPartitions = options.bufferPartitions;
+
+			// e.g. mp_rr_box.bsp.007f.bsp_lump
+			job.path = Format("%s.%04x.bsp_lump", bspPath.c_str(), job.index);
+
+			if (inventory.IsValid())
+			{
+				job.pInventory = &inventory;
+				job.pEntry = inventory.FindLump(job.index);
+
+				job.exists = job.pEntry != nullptr;
+				job.fileSize = job.exists ? job.pEntry->size : 0;
+				job.statDone = true;
+			}
+		}
+	}
+
+	const bool asyncIO = options.asyncIO && CIOBatch::IsAsyncAvailable();
+
+	if (asyncIO && !inventory.IsValid())
 	{
-		if (lump.filelen == 0)
-			continue;
+		// stat all lumps of the map in one go, instead of one blocking call
+		// per lump in LoadLump
+		TIME_SCOPE("StatLumps");
+		CIOBatch statBatch(true);
 
-		// retrieve lump index from temp storage in uncompLen
-		const int i = lump.uncompLen;
+		for (size_t k = 0; k < numJobs; k++)
+			statBatch.AddStat(jobs[k].path, jobs[k].fileSize);
 
-		// e.g. mp_rr_box.bsp.007f.bsp_lump
-		const std::string lumpPath = Format("%s.%04x.bsp_lump", bspPath.c_str(), i);
+		statBatch.Submit();
 
-		// make sure the lump file actually exists
-		if (!std::filesystem::exists(lumpPath))
+		for (size_t k = 0; k < numJobs; k++)
 		{
-			printf("Lump %04x file not found: %s\n", i, lumpPath.c_str());
-			continue;
+			jobs[k].exists = statBatch.Succeeded(k);
+			jobs[k].statDone = true;
 		}
+	}
 
-		size_t lumpSize = GetFileSize(lumpPath);
+	int nextLumpWriteOffset = sizeof(BSPHeader_t);
+
+	if (parallelWrite)
+	{
+		// lay out the whole bsp up front, so every lump can be written into
+		// its place as soon as it has been loaded, in any order
+		for (size_t k = 0; k < numJobs; k++)
+		{
+			LumpJob_t& job = jobs[k];
 
-		if (int(lumpSize) != lump.filelen)
-			printf("Lump %04x file size mismatch (file %i, bsp %i)\n", i, int(lumpSize), lump.filelen);
+			if (!GetPackedLumpSize(job, currentVersion, job.packedSize))
+				continue; // reported by LoadLump
 
-		CIOStream lumpIn;
+			job.pOut = &out;
+			job.writeOffset = uint64_t(nextLumpWriteOffset);
 
-		if (!lumpIn.Open(lumpPath, CIOStream::READ | CIOStream::BINARY))
-		{
-			printf("Failed to open lump \"%s\"\n", lumpPath.c_str());
-			continue;
+			nextLumpWriteOffset += int(job.packedSize);
 		}
 
-		char* lumpData = new char[lumpSize];
-		lumpIn.Read(lumpData, lumpSize);
+		if (!out.SetSize(uint64_t(nextLumpWriteOffset)))
+			ConvertError("Failed to preallocate output BSP file\n");
+	}
 
-		size_t lumpOffset = 0;
+	size_t numSubmitted = 0;
+	size_t numOpened = 0;
+	size_t numPrefetched = 0;
 
-		switch (i)
-		{
-		case LUMP_ENTITIES:
+	try
+	{
+		for (size_t k = 0; k < numJobs; k++)
 		{
-			if (currentVersion >= 48)
+			for (; numSubmitted < numJobs && numSubmitted < k + pipelineDepth; numSubmitted++)
 			{
-				CEntityPartitionMgr epson;
-				if (!epson.ParseFromBuffer(lumpData, false))
-					printf("%s: Failed to parse \"%s\"\n", __FUNCTION__, "LUMP_ENTITIES");
-				else
+				if (asyncIO && packAllLumps && numSubmitted == numOpened)
+					numOpened = OpenLumps(jobs, numOpened, std::min(numJobs, numOpened + LUMP_OPEN_BATCH_SIZE), currentVersion);
+
+				LumpJob_t& job = jobs[numSubmitted];
+				// a job only takes over a slot once the lump before it has
+				// been written and released it, so the memory held by the
+				// buffers of the lumps is bounded by the window
+				job.pArena = &arenaScope.GetSlot(numSubmitted % pipelineDepth);
+
+				if (pPool)
 				{
-					if (epson.ConvertEntityPartition())
-					{
-						std::string outBuf;
-						epson.WriteToString(outBuf);
-
-						// Copy into existing buffer; the sizes won't change
-						// as the conversion process removes 8 bytes and pads
-						// them elsewhere for alignment reasons (as of the RPak
-						// v12.1 change).
-						outBuf.copy(lumpData, outBuf.size());
-
-						if (!packAllLumps)
-							WriteNewLump(lumpPath, lumpData, lumpSize);
-					}
-					else
+					pPool->Submit(job.group, [&job, currentVersion, packAllLumps]()
 					{
-						printf("%s: Failed to convert \"%s\"\n", __FUNCTION__, "LUMP_ENTITIES");
-						assert(0);
-					}
+						// the pool doesn't carry exceptions, the writer
+						// rethrows it in the lump's place
+						try
+						{
+							LoadLump(job, currentVersion, packAllLumps);
+						}
+						catch (...)
+						{
+							job.error = std::current_exception();
+						}
+					});
 				}
+				else
+					LoadLump(job, currentVersion, packAllLumps);
 			}
 
-			break;
-		}
-		case LUMP_GAME_LUMP:
-		{
-			if (!packAllLumps)
+			// hint the OS about the lumps after the ones in flight, so their
+			// data is on its way by the time they get loaded; at most a batch
+			// of them is kept open ahead of the pipeline, the rest are only
+			// hinted through a handle that is closed again
+			const size_t prefetchEnd = std::min(numJobs, numSubmitted + options.prefetchWindow);
+			const size_t openEnd = std::min(numJobs, numSubmitted + LUMP_OPEN_BATCH_SIZE);
+
+			if (asyncIO && packAllLumps && prefetchEnd > numOpened && openEnd >= numOpened + LUMP_OPEN_BATCH_SIZE / 2)
+				numOpened = OpenLumps(jobs, numOpened, openEnd, currentVersion);
+
+			for (numPrefetched = std::max(numPrefetched, numSubmitted); numPrefetched < prefetchEnd; numPrefetched++)
+				PrefetchLump(jobs[numPrefetched], currentVersion, packAllLumps, numPrefetched < openEnd);
+
+			LumpJob_t& job = jobs[k];
+
+			if (pPool)
 			{
-				rmem lumpBuf(lumpData);
+				TIME_SCOPE("WaitForLump");
+				pPool->Wait(job.group);
+			}
 
-				FixGameLumpOffset(lumpBuf, nextLumpWriteOffset, packAllLumps);
-				WriteNewLump(lumpPath, lumpData, lumpSize);
+			// the messages of the lumps are printed in the order they are written
+			Msg("%s", job.output.c_str());
+
+			if (job.error)
+				std::rethrow_exception(job.error);
+
+			if (!job.loaded)
+			{
+				job.Release();
+				continue;
 			}
 
-			break;
-		}
-		case LUMP_LIGHTPROBES:
-		{
-			if (currentVersion >= 51)
+			const int i = job.index;
+			size_t lumpSize = job.size;
+
+			if (i == LUMP_LIGHTMAP_DATA_REAL_TIME_LIGHTS)
 			{
-				rmem lumpBuf(lumpData);
-				ConvertLightProbes_v51(lumpBuf, lumpData, lumpSize);
+				FixLightmapRTLSize(pHdr, packAllLumps);
+				lumpSize = job.fileLen;
+			}
 
-				if (!packAllLumps)
-					WriteNewLump(lumpPath, lumpData, lumpSize);
+			pHdr->lumps[i].fileofs = 0;
+			pHdr->lumps[i].filelen = int(lumpSize);
+
+			if (parallelWrite)
+			{
+				if (!job.written)
+					ConvertError("Failed to write lump %04x to output BSP file\n", i);
+
+				pHdr->lumps[i].fileofs = int(job.writeOffset);
+				pHdr->lumps[i].filelen = int(job.packedSize);
 			}
+			else if (packAllLumps)
+			{
+				CStatsScope statsScope(job.stats);
+				CAllocLumpScope allocScope(i);
+				TIME_SCOPE_DETAIL("WriteLump", job.path);
 
-			break;
-		}
-		case LUMP_LIGHTMAP_DATA_REAL_TIME_LIGHTS:
-		{
-			FixLightmapRTLSize(pHdr, packAllLumps);
-			lumpSize = lump.filelen;
+				pHdr->lumps[i].fileofs = nextLumpWriteOffset;
 
-			break;
-		}
-		}
+				bool written;
+
+				if (job.streamed)
+					written = WriteStreamedLump(job, out, uint64_t(nextLumpWriteOffset)) && out.Seek(uint64_t(nextLumpWriteOffset + lumpSize));
+				else if (job.data)
+					written = out.Write(job.data, lumpSize);
+				else
+					written = WritePackedLump(out, job.file, lumpSize);
 
-		pHdr->lumps[i].fileofs = int(lumpOffset);
-		pHdr->lumps[i].filelen = int(lumpSize);
+				if (!written)
+					ConvertError("Failed to write lump %04x to output BSP file\n", i);
 
-		if (packAllLumps)
-		{
-			pHdr->lumps[i].fileofs = nextLumpWriteOffset;
-			out.Write(lumpData, lumpSize);
-			nextLumpWriteOffset += int(lumpSize);
+				if (job.streamed)
+					job.stats.bytesRead = job.fileSize;
+
+				job.stats.bytesWritten = lumpSize;
+				nextLumpWriteOffset += int(lumpSize);
+			}
+
+			if (pStats)
+			{
+				job.stats.count = 1;
+				pStats->lumps[i].Add(job.stats, lumpSize);
+			}
+
+			// done with it, free the memory for the lumps further down the pipeline
+			job.Release();
 		}
+	}
+	catch (...)
+	{
+		// the tasks still in flight reference the jobs
+		for (size_t k = 0; pPool && k < numSubmitted; k++)
+			pPool->Wait(jobs[k].group);
 
-		delete[] lumpData;
+		throw;
 	}
 
+	TIME_SCOPE("WriteHeader");
+
 	// seek back to write the header
 	if (packAllLumps)
 		out.Seek(0);
 
-	out.Write(pHdr, sizeof(BSPHeader_t));
+	if (!out.Write(pHdr, sizeof(BSPHeader_t)))
+		ConvertError("Failed to write header to output BSP file\n");
+
+	partitionFixer.Finish(pStats);
 }
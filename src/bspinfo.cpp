@@ -0,0 +1,190 @@
+#include "stdafx.h"
+#include "bspinfo.h"
+#include "lumpinventory.h"
+#include "nativefile.h"
+#include "stltools.h"
+#include "stats.h"
+
+static const char* const s_lumpStatusNames[] =
+{
+	"empty",
+	"file",
+	"packed",
+	"missing",
+	"size_mismatch",
+	"unreferenced",
+};
+
+static inline bool IsLumpProblem(const LumpInfoStatus_t status)
+{
+	return status >= LUMPINFO_MISSING;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: reads the header of a map and checks its lumps against the files
+//			next to it, without reading any lump data
+// Input  : &bspPath -
+//			&info -
+// Output : true if the header could be read and is an rBSP header
+//-----------------------------------------------------------------------------
+bool ReadBspInfo(const std::string& bspPath, BspInfo_t& info)
+{
+	TIME_SCOPE_DETAIL("ReadBspInfo", bspPath);
+
+	info.path = bspPath;
+
+	CNativeFile bspIn;
+	if (!bspIn.Open(bspPath, CNativeFile::READ))
+	{
+		info.error = "failed to open file";
+		return false;
+	}
+
+	info.fileSize = bspIn.GetSize();
+
+	if (bspIn.ReadAt(&info.header, sizeof(BSPHeader_t), 0) != sizeof(BSPHeader_t))
+	{
+		info.error = Format("file is too small (must be at least 0x%x bytes)", unsigned(sizeof(BSPHeader_t)));
+		return false;
+	}
+
+	bspIn.Close();
+
+	const BSPHeader_t& header = info.header;
+
+	if (header.ident != 'PSBr')
+	{
+		info.error = "not an rBSP file";
+		return false;
+	}
+
+	if (header.lastLump < 0 || header.lastLump >= LUMP_COUNT)
+	{
+		info.error = Format("lastLump %i is out of range", header.lastLump);
+		return false;
+	}
+
+	info.valid = true;
+
+	CLumpInventory inventory;
+	inventory.Scan(bspPath);
+
+	for (int i = 0; i < LUMP_COUNT; i++)
+	{
+		const CLumpInventory::Entry_t* const pEntry = inventory.FindLump(i);
+		info.lumpFileSizes[i] = pEntry ? int64_t(pEntry->size) : -1;
+
+		if (pEntry)
+			info.numLumpFiles++;
+
+		// the lumps past lastLump aren't part of the map
+		const lump_t& lump = header.lumps[i];
+		const bool hasData = i <= header.lastLump && lump.filelen != 0;
+
+		// unpacked maps keep the offsets they had when packed, so a lump is
+		// only read from the .bsp when it has no file, like the game does
+		const uint64_t nLumpEnd = uint64_t(uint32_t(lump.fileofs)) + uint64_t(uint32_t(lump.filelen));
+		const bool isPacked = lump.fileofs >= int(sizeof(BSPHeader_t)) && nLumpEnd <= info.fileSize;
+
+		LumpInfoStatus_t status;
+
+		if (!hasData)
+			status = pEntry ? LUMPINFO_UNREFERENCED : LUMPINFO_EMPTY;
+		else if (pEntry)
+			status = pEntry->size == uint64_t(uint32_t(lump.filelen)) ? LUMPINFO_FILE : LUMPINFO_SIZE_MISMATCH;
+		else
+			status = isPacked ? LUMPINFO_PACKED : LUMPINFO_MISSING;
+
+		info.lumpStatus[i] = status;
+
+		if (hasData)
+			info.numLumps++;
+
+		if (IsLumpProblem(status))
+			info.numProblems++;
+	}
+
+	return true;
+}
+
+static void PrintLump(const BspInfo_t& info, const int i)
+{
+	const lump_t& lump = info.header.lumps[i];
+	const LumpInfoStatus_t status = info.lumpStatus[i];
+
+	const std::string fileSize = info.lumpFileSizes[i] >= 0 ? Format("%lld", (long long)info.lumpFileSizes[i]) : std::string("-");
+
+	printf("  %04x %-32s %10i %10i %7i %10i %10s %s\n", i, GetLumpName(i), lump.fileofs, lump.filelen,
+		lump.version, lump.uncompLen, fileSize.c_str(), s_lumpStatusNames[status]);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: prints the header of a map and its lumps
+// Input  : &info -
+//			printLumps - all lumps with data or a file, rather than only the
+//			ones with a problem
+//-----------------------------------------------------------------------------
+void PrintBspInfo(const BspInfo_t& info, const bool printLumps)
+{
+	if (!info.valid)
+	{
+		printf("%s: ERROR: %s\n", info.path.c_str(), info.error.c_str());
+		return;
+	}
+
+	const BSPHeader_t& header = info.header;
+
+	printf("%s: version %i, flags %i, mapRevision %i, lastLump %i, %llu bytes, %i lumps, %i lump files, %i problem(s)\n",
+		info.path.c_str(), header.version, header.flags, header.mapRevision, header.lastLump,
+		(unsigned long long)info.fileSize, info.numLumps, info.numLumpFiles, info.numProblems);
+
+	if (!printLumps && !info.numProblems)
+		return;
+
+	printf("  %-4s %-32s %10s %10s %7s %10s %10s %s\n", "idx", "name", "fileofs", "filelen", "version", "uncompLen", "file size", "status");
+
+	for (int i = 0; i < LUMP_COUNT; i++)
+	{
+		const LumpInfoStatus_t status = info.lumpStatus[i];
+
+		if (printLumps ? status != LUMPINFO_EMPTY : IsLumpProblem(status))
+			PrintLump(info, i);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: appends the header of a map and its whole lump table as a JSON
+//			object
+// Input  : &json -
+//			&info -
+//-----------------------------------------------------------------------------
+void AppendBspInfoJson(std::string& json, const BspInfo_t& info)
+{
+	json += "{\"path\":";
+	AppendJsonString(json, info.path);
+
+	if (!info.valid)
+	{
+		json += ",\"valid\":false,\"error\":";
+		AppendJsonString(json, info.error);
+		json += '}';
+		return;
+	}
+
+	const BSPHeader_t& header = info.header;
+
+	json += Format(",\"valid\":true,\"fileSize\":%llu,\"version\":%i,\"flags\":%i,\"mapRevision\":%i,\"lastLump\":%i,\"numLumps\":%i,\"numLumpFiles\":%i,\"numProblems\":%i,\"lumps\":[",
+		(unsigned long long)info.fileSize, header.version, header.flags, header.mapRevision, header.lastLump,
+		info.numLumps, info.numLumpFiles, info.numProblems);
+
+	for (int i = 0; i < LUMP_COUNT; i++)
+	{
+		const lump_t& lump = header.lumps[i];
+
+		json += Format("%s\n    {\"index\":%i,\"name\":\"%s\",\"fileofs\":%i,\"filelen\":%i,\"version\":%i,\"uncompLen\":%i,\"fileSize\":%lld,\"status\":\"%s\"}",
+			i ? "," : "", i, GetLumpName(i), lump.fileofs, lump.filelen, lump.version, lump.uncompLen,
+			(long long)info.lumpFileSizes[i], s_lumpStatusNames[info.lumpStatus[i]]);
+	}
+
+	json += "]}";
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "bspfile.h"
+
+// how a lump of the header compares to the files on disk
+enum LumpInfoStatus_t
+{
+	LUMPINFO_EMPTY = 0, // no data, no file
+	LUMPINFO_FILE, // in its .bsp_lump file, sizes match
+	LUMPINFO_PACKED, // no file, but inside the .bsp
+	LUMPINFO_MISSING, // has data but no file, and isn't inside the .bsp either
+	LUMPINFO_SIZE_MISMATCH, // the file's size differs from filelen
+	LUMPINFO_UNREFERENCED, // has a file but no data in the header
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: what -info reports about a map, taken from nothing but its header
+//			and one listing of its directory
+//-----------------------------------------------------------------------------
+struct BspInfo_t
+{
+	BspInfo_t() : valid(false), fileSize(0), header(), numLumps(0), numLumpFiles(0), numProblems(0) {}
+
+	std::string path;
+	std::string error; // why the header is invalid
+	bool valid;
+
+	uint64_t fileSize;
+	BSPHeader_t header;
+
+	int64_t lumpFileSizes[LUMP_COUNT]; // -1 if the lump has no file
+	LumpInfoStatus_t lumpStatus[LUMP_COUNT];
+
+	int numLumps; // with data in the header
+	int numLumpFiles;
+	int numProblems; // lumps missing, mismatched or unreferenced
+};
+
+bool ReadBspInfo(const std::string& bspPath, BspInfo_t& info);
+
+// the whole lump table if printLumps, otherwise a line for the map and one per
+// lump with a problem
+void PrintBspInfo(const BspInfo_t& info, const bool printLumps);
+void AppendBspInfoJson(std::string& json, const BspInfo_t& info);
@@ -0,0 +1,66 @@
+#include "stdafx.h"
+#include "cpufeatures.h"
+#include <atomic>
+
+#if defined(CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+
+static bool CPU_QueryAVX2()
+{
+	int regs[4];
+
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+		return false;
+
+	// the OS also has to save the upper halves of the YMM registers
+	__cpuid(regs, 1);
+	const bool hasAVX = (regs[2] & (1 << 28)) != 0;
+	const bool hasOSXSAVE = (regs[2] & (1 << 27)) != 0;
+
+	if (!hasAVX || !hasOSXSAVE || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+}
+
+static bool CPU_QuerySSSE3()
+{
+	int regs[4];
+	__cpuid(regs, 1);
+
+	return (regs[2] & (1 << 9)) != 0;
+}
+#elif defined(CPU_X86)
+static bool CPU_QueryAVX2() { return __builtin_cpu_supports("avx2"); }
+static bool CPU_QuerySSSE3() { return __builtin_cpu_supports("ssse3"); }
+#else
+static bool CPU_QueryAVX2() { return false; }
+static bool CPU_QuerySSSE3() { return false; }
+#endif
+
+static std::atomic<bool> s_bSIMDEnabled(true);
+
+bool CPU_HasSSSE3()
+{
+	static const bool s_hasSSSE3 = CPU_QuerySSSE3();
+	return s_hasSSSE3 && CPU_IsSIMDEnabled();
+}
+
+bool CPU_HasAVX2()
+{
+	static const bool s_hasAVX2 = CPU_QueryAVX2();
+	return s_hasAVX2 && CPU_IsSIMDEnabled();
+}
+
+void CPU_SetSIMDEnabled(const bool bEnabled)
+{
+	s_bSIMDEnabled.store(bEnabled, std::memory_order_relaxed);
+}
+
+bool CPU_IsSIMDEnabled()
+{
+	return s_bSIMDEnabled.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#endif
+
+// functions using instruction sets above the compiler's baseline have to be
+// tagged on GCC/Clang, MSVC allows any intrinsic anywhere
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+
+// runtime instruction set checks, SSE2 is the x64 baseline and always present
+bool CPU_HasSSSE3();
+bool CPU_HasAVX2();
+
+// with SIMD disabled the checks above fail and the baseline SSE2 paths aren't
+// taken either, so the scalar paths run; the SIMD paths are verified against
+// them this way, see bench/verify.cpp
+void CPU_SetSIMDEnabled(const bool bEnabled);
+bool CPU_IsSIMDEnabled();
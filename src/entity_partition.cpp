@@ -7,41 +7,44 @@
 
 #define MAX_COLLISION_CHUNK_SIZE 0x78
 
-const char* CEntityPartitionMgr::ParseQuoted(const char* const subKeyStart, const char* const subKeyEnd, std::string& quoted)
+const char* CEntityPartitionMgr::ParseQuoted(const char* const subKeyStart, const char* const subKeyEnd, std::string_view& quoted)
 {
 	assert(subKeyStart && subKeyEnd);
 	assert(quoted.empty());
 
-	const char* it = subKeyStart;
-	it = strchr(it, '"'); // Leading '"'.
+	if (subKeyStart >= subKeyEnd)
+	{
+		// NULL or exceeds end.
+		return nullptr;
+	}
+
+	// Leading '"'.
+	const char* it = static_cast<const char*>(memchr(subKeyStart, '"', subKeyEnd - subKeyStart));
 
-	if (it && it < subKeyEnd)
+	if (!it)
 	{
-		it++;
-		if (!*it)
-		{
-			// Unexpected end???
-			return nullptr;
-		}
+		// NULL or exceeds end.
+		return nullptr;
+	}
 
-		while (*it != '"')
-		{
-			if (it >= subKeyEnd)
-			{
-				// Exceeds object end; missing trailing '"'???
-				assert(0);
-				return nullptr;
-			}
+	it++;
+	if (!*it)
+	{
+		// Unexpected end???
+		return nullptr;
+	}
 
-			quoted += *it;
-			it++;
-		}
+	const char* const quoteEnd = static_cast<const char*>(memchr(it, '"', subKeyEnd - it));
 
-		return it;
+	if (!quoteEnd)
+	{
+		// Exceeds object end; missing trailing '"'???
+		assert(0);
+		return nullptr;
 	}
 
-	// NULL or exceeds end.
-	return nullptr;
+	quoted = std::string_view(it, quoteEnd - it);
+	return quoteEnd;
 }
 
 const char* CEntityPartitionMgr::ParseKeyValue(const char* const subKeyStart, const char* const subKeyEnd, Object_t& subKey)
@@ -130,7 +133,7 @@ bool CEntityPartitionMgr::ParseFromBuffer(const char* const partitionBuffer, con
 				Object_t subKey;
 				ParseKeyValues(objectIt, subKeyEnd, subKey);
 
-				m_base.push_back(subKey);
+				m_base.push_back(std::move(subKey));
 				objectIt = strchr(subKeyEnd, '{');
 			}
 		}
@@ -187,7 +190,14 @@ void CEntityPartitionMgr::WriteToString(std::string& buffer)
 
 		for (const Field_t& kv : sub.keyValues)
 		{
-			buffer.append(Format("\"%s\" \"%s\"\n", kv.GetKey(), kv.GetValue()));
+			const std::string_view key = kv.GetKey();
+			const std::string_view value = kv.GetValue();
+
+			buffer += '"';
+			buffer.append(key.data(), key.size());
+			buffer.append("\" \"");
+			buffer.append(value.data(), value.size());
+			buffer.append("\"\n");
 		}
 
 		buffer.append("}\n");
@@ -199,27 +209,26 @@ bool CEntityPartitionMgr::ConvertEntityPartition()
 	// Convert all brush models from v12.1 -> v8.
 	for (Object_t& sub : m_base)
 	{
-		std::vector<uint8_t> outVec;
-		if (!DecodeBrushModel(sub, outVec))
+		m_brushModelFields.clear();
+
+		if (!GetBrushModelFields(sub, m_brushModelFields))
 		{
 			// This object doesn't contain brush model fields
 			// continue to the next one...
 			continue;
 		}
 
-		if (!ConvertBrushModel(outVec))
-		{
-			// BUG!!!
-			assert(0);
-			return false;
-		}
+		DecodeBrushModel(m_brushModelFields, m_brushModelData);
+		m_convertedBrushModelData.resize(m_brushModelData.size());
 
-		if (!EncodeBrushModel(sub, outVec))
+		if (!ConvertBrushModel(m_brushModelData.data(), m_brushModelData.size(), m_convertedBrushModelData.data()))
 		{
 			// BUG!!!
 			assert(0);
 			return false;
 		}
+
+		EncodeBrushModel(sub, m_brushModelFields, m_convertedBrushModelData.data(), m_convertedBrushModelData.size());
 	}
 
 	return true;
@@ -230,12 +239,12 @@ bool CEntityPartitionMgr::GetBrushModelFields(Object_t& object, std::vector<Fiel
 	for (size_t i = 0; i < object.keyValues.size(); i++)
 	{
 		Field_t* const field = &object.keyValues[i];
-		const char* const attrib = field->GetKey();
+		const std::string_view attrib = field->GetKey();
 
-		if (attrib[0] != '*')
+		if (attrib.empty() || attrib[0] != '*')
 			continue;
 
-		if (!strstr(attrib, "*coll"))
+		if (attrib.find("*coll") == std::string_view::npos)
 			continue;
 
 		brushModelFields.push_back(field);
@@ -248,63 +257,60 @@ bool CEntityPartitionMgr::GetBrushModelFields(Object_t& object, std::vector<Fiel
 	return true;
 }
 
-bool CEntityPartitionMgr::DecodeBrushModel(Object_t& object, std::vector<uint8_t>& brushModelData)
+void CEntityPartitionMgr::DecodeBrushModel(const std::vector<Field_t*>& brushModelFields, std::vector<uint8_t>& brushModelData)
 {
-	std::vector<Field_t*> brushModelFields;
+	size_t maxSize = 0;
 
-	if (!GetBrushModelFields(object, brushModelFields))
-		return false;
+	for (const Field_t* const field : brushModelFields)
+		maxSize += Base64DecodedSizeMax(field->GetValue().size());
+
+	brushModelData.resize(maxSize);
+	size_t size = 0;
 
+	// Chunks are decoded back to back, straight into the scratch buffer.
 	for (const Field_t* const field : brushModelFields)
 	{
-		const std::vector<uint8_t> partColData = Base64Decode(field->GetValue());
-		brushModelData.insert(brushModelData.end(), partColData.begin(), partColData.end());
+		const std::string_view value = field->GetValue();
+		size += Base64Decode(value.data(), value.size(), brushModelData.data() + size);
 	}
 
-	return true;
+	brushModelData.resize(size);
 }
 
-bool CEntityPartitionMgr::EncodeBrushModel(Object_t& object, const std::vector<unsigned char>& brushModelData)
+void CEntityPartitionMgr::EncodeBrushModel(Object_t& object, const std::vector<Field_t*>& brushModelFields, const uint8_t* const brushModelData, const size_t brushModelSize)
 {
-	std::vector<Field_t*> collisionFields;
-
-	if (!GetBrushModelFields(object, collisionFields))
-		return false;
-
-	const size_t newCollDataSize = brushModelData.size();
-	const size_t numChunks = newCollDataSize / MAX_COLLISION_CHUNK_SIZE;
-	size_t remainingSize = newCollDataSize;
+	size_t numChunks = 0;
 
-	std::vector<std::string> encodedCollData;
-
-	for (size_t i = 0; i <= numChunks && remainingSize; i++)
+	// Each chunk is encoded straight into the storage of the field it replaces.
+	for (size_t offset = 0; offset < brushModelSize && numChunks < brushModelFields.size(); offset += MAX_COLLISION_CHUNK_SIZE)
 	{
-		const size_t chunkSize = (remainingSize > MAX_COLLISION_CHUNK_SIZE) ? MAX_COLLISION_CHUNK_SIZE : remainingSize;
-		remainingSize -= chunkSize;
+		const size_t chunkSize = std::min(brushModelSize - offset, size_t(MAX_COLLISION_CHUNK_SIZE));
+		Field_t* const field = brushModelFields[numChunks++];
 
-		std::string encoded = Base64Encode(reinterpret_cast<const char*>(&brushModelData[i * MAX_COLLISION_CHUNK_SIZE]), chunkSize);
-		encodedCollData.emplace_back(std::move(encoded));
+		Base64Encode(reinterpret_cast<const char*>(&brushModelData[offset]), chunkSize, field->ownedValue);
+		field->ownsValue = true;
 	}
 
-	assert(remainingSize == NULL);
+	// Should never happen, the conversion doesn't change the size.
+	assert(brushModelFields.size() * MAX_COLLISION_CHUNK_SIZE >= brushModelSize);
 
-	for (size_t i = 0; i < collisionFields.size(); i++)
+	// New encoded collision is smaller, additional chunks can be dropped. The
+	// fields are sorted by address, remove them back to front so the remaining
+	// pointers stay valid.
+	for (size_t i = brushModelFields.size(); i > numChunks; i--)
 	{
-		Field_t* const field = collisionFields[i];
-		if (i < encodedCollData.size())
-			field->SetValue(encodedCollData[i].c_str());
-		else // New encoded collision is smaller, additional chunks can be dropped.
-			object.Remove(field->GetKey());
+		Field_t* const field = brushModelFields[i - 1];
+		object.keyValues.erase(object.keyValues.begin() + (field - object.keyValues.data()));
 	}
-
-	return true;
 }
 
-bool CEntityPartitionMgr::ConvertBrushModel(std::vector<uint8_t>& brushModelData)
+// writes the v8 layout of the v12.1 brush model at brushModelData to
+// outBrushModelData, which has to be brushModelSize bytes as well
+bool CEntityPartitionMgr::ConvertBrushModel(const uint8_t* const brushModelData, const size_t brushModelSize, uint8_t* const outBrushModelData)
 {
-	if (brushModelData.empty())
+	if (brushModelSize < sizeof(r5::v121::dbrushmodel_t))
 	{
-		// Called on an empty buffer!!!
+		// Called on an empty or truncated buffer!!!
 		assert(0);
 		return false;
 	}
@@ -313,15 +319,26 @@ bool CEntityPartitionMgr::ConvertBrushModel(std::vector<uint8_t>& brushModelData
 	const size_t offset = offsetof(r5::v121::dbrushmodel_t, header.unkIndex);
 	const size_t numBytesToRemove = sizeof(r5::v121::mstudiocollheader_t) - sizeof(r5::v8::mstudiocollheader_t);
 
-	// Add padding up to # 'bytes to remove' to maintain SIMD alignment of BVH nodes.
-	r5::v121::dbrushmodel_t* const pOldBrushModel = reinterpret_cast<r5::v121::dbrushmodel_t*>(&brushModelData[0]);
-	brushModelData.insert(brushModelData.begin() + pOldBrushModel->header.bvhNodeIndex, numBytesToRemove, '\0');
+	const r5::v121::dbrushmodel_t* const pOldBrushModel = reinterpret_cast<const r5::v121::dbrushmodel_t*>(brushModelData);
+	const size_t bvhNodeIndex = size_t(pOldBrushModel->header.bvhNodeIndex);
 
-	// Remove the new fields for v8 compatibility.
-	brushModelData.erase(brushModelData.begin() + offset, brushModelData.begin() + (offset + numBytesToRemove));
+	if (pOldBrushModel->header.bvhNodeIndex < 0 || bvhNodeIndex < offset + numBytesToRemove || bvhNodeIndex > brushModelSize)
+	{
+		// BVH nodes overlap the header or are out of bounds!!!
+		assert(0);
+		return false;
+	}
+
+	// Remove the new fields for v8 compatibility, and add padding up to
+	// # 'bytes to remove' in front of the BVH nodes to maintain their SIMD
+	// alignment.
+	memcpy(outBrushModelData, brushModelData, offset);
+	memcpy(outBrushModelData + offset, brushModelData + offset + numBytesToRemove, bvhNodeIndex - (offset + numBytesToRemove));
+	memset(outBrushModelData + bvhNodeIndex - numBytesToRemove, 0, numBytesToRemove);
+	memcpy(outBrushModelData + bvhNodeIndex, brushModelData + bvhNodeIndex, brushModelSize - bvhNodeIndex);
 
 	// adjust header offsets to account for the difference in structs between v10 and v12.1
-	r5::v8::dbrushmodel_t* const pNewBrushModel = reinterpret_cast<r5::v8::dbrushmodel_t*>(&brushModelData[0]);
+	r5::v8::dbrushmodel_t* const pNewBrushModel = reinterpret_cast<r5::v8::dbrushmodel_t*>(outBrushModelData);
 
 	pNewBrushModel->model.contentMasksIndex -= numBytesToRemove;
 	pNewBrushModel->model.surfacePropsIndex -= numBytesToRemove;
@@ -331,3 +348,269 @@ bool CEntityPartitionMgr::ConvertBrushModel(std::vector<uint8_t>& brushModelData
 
 	return true;
 }
+
+CEntityPartitionStream::CEntityPartitionStream(const bool parseHeader)
+{
+	m_numObjects = 0;
+	m_parseHeader = parseHeader;
+	m_headerDone = false;
+	m_failed = false;
+	m_done = false;
+}
+
+bool CEntityPartitionStream::Process(const char* const data, const size_t size, std::string& output)
+{
+	if (m_failed)
+	{
+		return false;
+	}
+
+	if (m_done)
+	{
+		return true;
+	}
+
+	if (m_pending.empty())
+	{
+		const size_t consumed = ProcessBuffer(std::string_view(data, size), false, output);
+		m_pending.assign(data + consumed, size - consumed);
+	}
+	else
+	{
+		m_pending.append(data, size);
+
+		const size_t consumed = ProcessBuffer(m_pending, false, output);
+		m_pending.erase(0, consumed);
+	}
+
+	return !m_failed;
+}
+
+bool CEntityPartitionStream::Finish(std::string& output)
+{
+	if (!m_failed && !m_done && !m_pending.empty())
+	{
+		ProcessBuffer(m_pending, true, output);
+		m_pending.clear();
+	}
+
+	if (m_failed)
+	{
+		return false;
+	}
+
+	if (!m_numObjects)
+	{
+		// Partition file is empty.
+		return false;
+	}
+
+	return true;
+}
+
+size_t CEntityPartitionStream::ProcessBuffer(const std::string_view buffer, const bool isFinal, std::string& output)
+{
+	const char* const bufferStart = buffer.data();
+	const char* const bufferEnd = bufferStart + buffer.size();
+	const char* it = bufferStart;
+
+	if (!m_headerDone)
+	{
+		const char* headerEnd = it;
+
+		while (headerEnd < bufferEnd && *headerEnd != '{' && *headerEnd != '\0')
+		{
+			headerEnd++;
+		}
+
+		if (headerEnd == bufferEnd && !isFinal)
+		{
+			// Need the whole header before it can be parsed.
+			return 0;
+		}
+
+		if (m_parseHeader)
+		{
+			const std::string header(it, headerEnd);
+			CEntityPartitionMgr headerParser;
+
+			if (!headerParser.ParseHeader(header.c_str()))
+			{
+				assert(0);
+				m_failed = true;
+				return 0;
+			}
+
+			// Same header the manager would write.
+			headerParser.WriteToString(output);
+		}
+
+		m_headerDone = true;
+		it = headerEnd;
+	}
+
+	while (it < bufferEnd)
+	{
+		// Anything between objects is dropped, same as the manager does.
+		while (it < bufferEnd && *it != '{' && *it != '\0')
+		{
+			it++;
+		}
+
+		if (it == bufferEnd)
+		{
+			break;
+		}
+
+		if (*it == '\0')
+		{
+			m_done = true;
+			return buffer.size();
+		}
+
+		const char* const objectEnd = static_cast<const char*>(memchr(it, '}', bufferEnd - it));
+		const char* const terminator = static_cast<const char*>(memchr(it, '\0', (objectEnd ? objectEnd : bufferEnd) - it));
+
+		if (terminator || (!objectEnd && isFinal))
+		{
+			// Truncated entity partition!!!
+			assert(0);
+			m_failed = true;
+			return size_t(it - bufferStart);
+		}
+
+		if (!objectEnd)
+		{
+			// The rest of the object is in the next piece.
+			break;
+		}
+
+		if (!ProcessObject(it, objectEnd, output))
+		{
+			m_failed = true;
+			return size_t(it - bufferStart);
+		}
+
+		m_numObjects++;
+		it = objectEnd + 1;
+	}
+
+	return size_t(it - bufferStart);
+}
+
+static void AppendField(std::string& output, const std::string_view key, const std::string_view value)
+{
+	output += '"';
+	output.append(key.data(), key.size());
+	output.append("\" \"");
+	output.append(value.data(), value.size());
+	output.append("\"\n");
+}
+
+bool CEntityPartitionStream::ProcessObject(const char* const objectStart, const char* const objectEnd, std::string& output)
+{
+	m_fields.clear();
+	m_brushModelFields.clear();
+
+	const char* it = objectStart;
+
+	for (;;)
+	{
+		CEntityPartitionMgr::Field_t kv;
+		const char* const keyEnd = CEntityPartitionMgr::ParseQuoted(it, objectEnd, kv.key);
+
+		if (!keyEnd)
+		{
+			break;
+		}
+
+		const char* const valueEnd = CEntityPartitionMgr::ParseQuoted(keyEnd + 1, objectEnd, kv.value);
+
+		if (!valueEnd)
+		{
+			break;
+		}
+
+		if (!kv.key.empty() && kv.key[0] == '*' && kv.key.find("*coll") != std::string_view::npos)
+		{
+			m_brushModelFields.push_back(m_fields.size());
+		}
+
+		m_fields.emplace_back(kv.key, kv.value);
+		it = valueEnd + 1;
+	}
+
+	output.append("{\n");
+
+	if (m_brushModelFields.empty())
+	{
+		for (const auto& kv : m_fields)
+		{
+			AppendField(output, kv.first, kv.second);
+		}
+
+		output.append("}\n");
+		return true;
+	}
+
+	size_t maxSize = 0;
+
+	for (const size_t fieldIdx : m_brushModelFields)
+	{
+		maxSize += Base64DecodedSizeMax(m_fields[fieldIdx].second.size());
+	}
+
+	m_brushModelData.resize(maxSize);
+	size_t dataSize = 0;
+
+	for (const size_t fieldIdx : m_brushModelFields)
+	{
+		const std::string_view value = m_fields[fieldIdx].second;
+		dataSize += Base64Decode(value.data(), value.size(), m_brushModelData.data() + dataSize);
+	}
+
+	m_convertedBrushModelData.resize(dataSize);
+
+	if (!CEntityPartitionMgr::ConvertBrushModel(m_brushModelData.data(), dataSize, m_convertedBrushModelData.data()))
+	{
+		// BUG!!!
+		assert(0);
+		return false;
+	}
+
+	size_t brushModelIdx = 0;
+
+	for (size_t i = 0; i < m_fields.size(); i++)
+	{
+		if (brushModelIdx >= m_brushModelFields.size() || m_brushModelFields[brushModelIdx] != i)
+		{
+			AppendField(output, m_fields[i].first, m_fields[i].second);
+			continue;
+		}
+
+		const size_t chunkOffset = brushModelIdx++ * MAX_COLLISION_CHUNK_SIZE;
+
+		if (chunkOffset >= dataSize)
+		{
+			// New encoded collision is smaller, additional chunks can be dropped.
+			continue;
+		}
+
+		const size_t chunkSize = std::min(dataSize - chunkOffset, size_t(MAX_COLLISION_CHUNK_SIZE));
+		const std::string_view key = m_fields[i].first;
+
+		// Encode the chunk straight into the output.
+		output += '"';
+		output.append(key.data(), key.size());
+		output.append("\" \"");
+
+		const size_t encodedOffset = output.size();
+		output.resize(encodedOffset + Base64EncodedSize(chunkSize));
+		Base64Encode(reinterpret_cast<const char*>(&m_convertedBrushModelData[chunkOffset]), chunkSize, &output[encodedOffset]);
+
+		output.append("\"\n");
+	}
+
+	output.append("}\n");
+	return true;
+}
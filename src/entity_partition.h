@@ -2,24 +2,37 @@
 
 class CEntityPartitionMgr
 {
+	friend class CEntityPartitionStream;
+
 private:
+	// keys and values are views into the buffer passed to ParseFromBuffer, they
+	// are only copied into the field once they get modified
 	struct Field_t
 	{
-		inline const char* GetKey() const { return key.c_str(); }
-		inline void SetKey(const char* newKey) { key = newKey; }
-		inline const char* GetValue() const { return value.c_str(); }
-		inline void SetValue(const char* newValue) { value = newValue; }
-
-		std::string key;
-		std::string value;
+		Field_t() : ownsKey(false), ownsValue(false) {}
+
+		inline std::string_view GetKey() const { return ownsKey ? std::string_view(ownedKey) : key; }
+		inline void SetKey(const std::string_view newKey) { ownedKey.assign(newKey.data(), newKey.size()); ownsKey = true; }
+		inline std::string_view GetValue() const { return ownsValue ? std::string_view(ownedValue) : value; }
+		inline void SetValue(const std::string_view newValue) { ownedValue.assign(newValue.data(), newValue.size()); ownsValue = true; }
+
+		std::string_view key;
+		std::string_view value;
+
+		// views into these are handed out on every Get call instead of being
+		// stored, as moving the field may move their (small string) storage
+		std::string ownedKey;
+		std::string ownedValue;
+		bool ownsKey;
+		bool ownsValue;
 	};
 
 	struct Object_t
 	{
-		inline std::vector<Field_t>::iterator Find(const char* const key)
+		inline std::vector<Field_t>::iterator Find(const std::string_view key)
 		{
 			return std::find_if(keyValues.begin(), keyValues.end(),
-				[&key](const Field_t& element) { return element.key == key; });
+				[&key](const Field_t& element) { return element.GetKey() == key; });
 		}
 		inline void Add(Field_t& field)
 		{
@@ -27,9 +40,9 @@ private:
 		}
 		inline void Add(Field_t&& field)
 		{
-			keyValues.push_back(field);
+			keyValues.push_back(std::move(field));
 		}
-		inline void Remove(const char* key)
+		inline void Remove(const std::string_view key)
 		{
 			const auto it = Find(key);
 
@@ -39,7 +52,7 @@ private:
 			}
 		}
 
-		Field_t* FindKey(const char* const key)
+		Field_t* FindKey(const std::string_view key)
 		{
 			const auto it = Find(key);
 
@@ -56,7 +69,7 @@ private:
 
 	typedef std::vector<Object_t> Node_t;
 
-	const char* ParseQuoted(const char* const subKeyStart, const char* const subKeyEnd, std::string& quoted);
+	static const char* ParseQuoted(const char* const subKeyStart, const char* const subKeyEnd, std::string_view& quoted);
 	const char* ParseKeyValue(const char* const subKeyStart, const char* const subKeyEnd, Object_t& subKey);
 	void ParseKeyValues(const char* const subKeyStart, const char* const subKeyEnd, Object_t& subKey);
 
@@ -65,12 +78,13 @@ private:
 private: // Internal tools;
 	bool GetBrushModelFields(Object_t& object, std::vector<Field_t*>& brushModelFields);
 
-	bool EncodeBrushModel(Object_t& object, const std::vector<unsigned char>& brushModelData);
-	bool DecodeBrushModel(Object_t& object, std::vector<unsigned char>& brushModelData);
-	bool ConvertBrushModel(std::vector<uint8_t>& brushModelData);
+	void EncodeBrushModel(Object_t& object, const std::vector<Field_t*>& brushModelFields, const uint8_t* const brushModelData, const size_t brushModelSize);
+	void DecodeBrushModel(const std::vector<Field_t*>& brushModelFields, std::vector<uint8_t>& brushModelData);
+	static bool ConvertBrushModel(const uint8_t* const brushModelData, const size_t brushModelSize, uint8_t* const outBrushModelData);
 
 public:
 	CEntityPartitionMgr() { m_numHeaderFields = 0;  m_entities = -1; m_numModels = -1; }
+	// the parsed fields reference partitionBuffer, it has to outlive the manager!
 	bool ParseFromBuffer(const char* const partitionBuffer, const bool parseHeader);
 	bool Write(const char* const fileName);
 	void WriteToString(std::string& buffer);
@@ -82,4 +96,50 @@ private:
 	int m_entities;
 	int m_numModels;
 	Node_t m_base;
+
+	// scratch, reused between objects
+	std::vector<Field_t*> m_brushModelFields;
+	std::vector<uint8_t> m_brushModelData;
+	std::vector<uint8_t> m_convertedBrushModelData;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: single pass entity partition converter
+//
+// Produces the same output as CEntityPartitionMgr (parse, convert, write), but
+// converts and writes each object as soon as it has been parsed instead of
+// building the whole partition in memory first. Input may be passed in pieces
+// of any size; only an object that straddles two pieces is buffered, so memory
+// use is bounded by the largest object.
+//-----------------------------------------------------------------------------
+class CEntityPartitionStream
+{
+public:
+	CEntityPartitionStream(const bool parseHeader);
+
+	// converts the next piece of the partition, the result is appended to output
+	bool Process(const char* const data, const size_t size, std::string& output);
+	// fails if the partition was empty or ended inside an object
+	bool Finish(std::string& output);
+
+	// the partition is terminated by a '\0', anything after it is ignored
+	inline bool IsDone() const { return m_done; }
+
+private:
+	size_t ProcessBuffer(const std::string_view buffer, const bool isFinal, std::string& output);
+	bool ProcessObject(const char* const objectStart, const char* const objectEnd, std::string& output);
+
+	std::string m_pending; // unprocessed tail of the previous piece
+
+	// scratch, reused between objects
+	std::vector<std::pair<std::string_view, std::string_view>> m_fields;
+	std::vector<size_t> m_brushModelFields;
+	std::vector<uint8_t> m_brushModelData;
+	std::vector<uint8_t> m_convertedBrushModelData;
+
+	size_t m_numObjects;
+	bool m_parseHeader;
+	bool m_headerDone;
+	bool m_failed;
+	bool m_done;
 };
@@ -0,0 +1,527 @@
+#include "stdafx.h"
+#include "iobatch.h"
+
+#include <thread>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+// upper bound of operations in flight at once, larger batches are submitted
+// in several rounds
+#define IO_BATCH_RING_ENTRIES 256
+
+// set in the user data of opens, so the fd of an open that completes after its
+// batch has given up on the ring can still be closed
+#define IO_BATCH_OPEN_FLAG (uint64_t(1) << 63)
+
+#ifdef __linux__
+//-----------------------------------------------------------------------------
+// Purpose: minimal io_uring instance on top of the raw syscalls
+//-----------------------------------------------------------------------------
+class CIOUring
+{
+public:
+	CIOUring();
+	~CIOUring();
+
+	bool Init(const unsigned numEntries);
+
+	io_uring_sqe* GetSqe();
+	bool Submit(const unsigned numToWait);
+	bool PopCqe(uint64_t& userData, int& result);
+
+	inline unsigned GetNumEntries() const { return m_numEntries; }
+	// entries handed to the kernel that it hasn't consumed yet, they are the
+	// most recently queued ones
+	inline unsigned GetNumUnsubmitted() const { return m_numUnsubmitted; }
+
+private:
+	int m_fd;
+	unsigned m_numEntries;
+	unsigned m_numQueued; // prepared but not yet handed to the kernel
+	unsigned m_numUnsubmitted; // handed to the kernel, but not consumed by it yet
+
+	void* m_pSqRing;
+	size_t m_sqRingSize;
+	void* m_pCqRing;
+	size_t m_cqRingSize;
+	io_uring_sqe* m_pSqes;
+	size_t m_sqesSize;
+
+	unsigned* m_pSqHead;
+	unsigned* m_pSqTail;
+	unsigned* m_pSqMask;
+	unsigned* m_pSqArray;
+
+	unsigned* m_pCqHead;
+	unsigned* m_pCqTail;
+	unsigned* m_pCqMask;
+	io_uring_cqe* m_pCqes;
+};
+
+CIOUring::CIOUring()
+{
+	m_fd = -1;
+	m_numEntries = 0;
+	m_numQueued = 0;
+	m_numUnsubmitted = 0;
+
+	m_pSqRing = MAP_FAILED;
+	m_sqRingSize = 0;
+	m_pCqRing = MAP_FAILED;
+	m_cqRingSize = 0;
+	m_pSqes = reinterpret_cast<io_uring_sqe*>(MAP_FAILED);
+	m_sqesSize = 0;
+}
+
+CIOUring::~CIOUring()
+{
+	if (m_pSqes != MAP_FAILED)
+		munmap(m_pSqes, m_sqesSize);
+	if (m_pCqRing != MAP_FAILED && m_pCqRing != m_pSqRing)
+		munmap(m_pCqRing, m_cqRingSize);
+	if (m_pSqRing != MAP_FAILED)
+		munmap(m_pSqRing, m_sqRingSize);
+	if (m_fd != -1)
+		close(m_fd);
+}
+
+bool CIOUring::Init(const unsigned numEntries)
+{
+	io_uring_params params = {};
+
+	m_fd = int(syscall(__NR_io_uring_setup, numEntries, &params));
+	if (m_fd < 0)
+	{
+		m_fd = -1;
+		return false;
+	}
+
+	m_numEntries = params.sq_entries;
+
+	m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+	const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+	if (singleMmap)
+		m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+
+	m_pSqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	if (m_pSqRing == MAP_FAILED)
+		return false;
+
+	m_pCqRing = singleMmap ? m_pSqRing : mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+	if (m_pCqRing == MAP_FAILED)
+		return false;
+
+	m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	m_pSqes = reinterpret_cast<io_uring_sqe*>(mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+	if (m_pSqes == MAP_FAILED)
+		return false;
+
+	char* const pSq = reinterpret_cast<char*>(m_pSqRing);
+	m_pSqHead = reinterpret_cast<unsigned*>(pSq + params.sq_off.head);
+	m_pSqTail = reinterpret_cast<unsigned*>(pSq + params.sq_off.tail);
+	m_pSqMask = reinterpret_cast<unsigned*>(pSq + params.sq_off.ring_mask);
+	m_pSqArray = reinterpret_cast<unsigned*>(pSq + params.sq_off.array);
+
+	char* const pCq = reinterpret_cast<char*>(m_pCqRing);
+	m_pCqHead = reinterpret_cast<unsigned*>(pCq + params.cq_off.head);
+	m_pCqTail = reinterpret_cast<unsigned*>(pCq + params.cq_off.tail);
+	m_pCqMask = reinterpret_cast<unsigned*>(pCq + params.cq_off.ring_mask);
+	m_pCqes = reinterpret_cast<io_uring_cqe*>(pCq + params.cq_off.cqes);
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: returns the next free submission entry, cleared; nullptr if the
+//			submission queue is full
+//-----------------------------------------------------------------------------
+io_uring_sqe* CIOUring::GetSqe()
+{
+	const unsigned head = __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE);
+	const unsigned tail = *m_pSqTail + m_numQueued;
+
+	if (tail - head >= m_numEntries)
+		return nullptr;
+
+	const unsigned idx = tail & *m_pSqMask;
+	m_pSqArray[idx] = idx;
+	m_numQueued++;
+
+	io_uring_sqe* const pSqe = &m_pSqes[idx];
+	memset(pSqe, 0, sizeof(io_uring_sqe));
+
+	return pSqe;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: hands the prepared entries to the kernel and waits until at least
+//			numToWait completions are available
+//
+// The kernel may consume fewer entries than it is given, it doesn't wait then;
+// the rest is handed to it again until all have been consumed. On failure
+// GetNumUnsubmitted tells how many it never got, errno is set.
+//-----------------------------------------------------------------------------
+bool CIOUring::Submit(const unsigned numToWait)
+{
+	__atomic_store_n(m_pSqTail, *m_pSqTail + m_numQueued, __ATOMIC_RELEASE);
+
+	m_numUnsubmitted += m_numQueued;
+	m_numQueued = 0;
+
+	for (;;)
+	{
+		const unsigned numToSubmit = m_numUnsubmitted;
+		const int ret = int(syscall(__NR_io_uring_enter, m_fd, numToSubmit, numToWait, IORING_ENTER_GETEVENTS, nullptr, 0));
+
+		if (ret < 0)
+		{
+			// a signal interrupted the submit or the wait, whatever was
+			// consumed is reflected by the submission queue's head
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		m_numUnsubmitted -= std::min(unsigned(ret), numToSubmit);
+
+		if (!m_numUnsubmitted)
+			return true;
+
+		if (!ret)
+		{
+			// no progress, the kernel is out of resources for the moment
+			errno = EAGAIN;
+			return false;
+		}
+	}
+}
+
+bool CIOUring::PopCqe(uint64_t& userData, int& result)
+{
+	const unsigned head = *m_pCqHead;
+
+	if (head == __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE))
+		return false;
+
+	const io_uring_cqe& cqe = m_pCqes[head & *m_pCqMask];
+	userData = cqe.user_data;
+	result = cqe.res;
+
+	__atomic_store_n(m_pCqHead, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+// rings are reused by all batches submitted from the same thread
+static thread_local std::unique_ptr<CIOUring> s_pThreadRing;
+
+//-----------------------------------------------------------------------------
+// Purpose: a ring that failed while operations were still in flight
+//
+// It is never entered again, but it and the statx buffers the kernel may still
+// write to are kept until the thread exits; the fds of opens that completed in
+// the meantime are closed then.
+//-----------------------------------------------------------------------------
+struct RetiredRing_t
+{
+	RetiredRing_t(std::unique_ptr<CIOUring>&& pFailedRing, std::vector<char>&& inFlightStatBuffers) : pRing(std::move(pFailedRing)), statBuffers(std::move(inFlightStatBuffers)) {}
+	RetiredRing_t(RetiredRing_t&&) = default;
+
+	~RetiredRing_t()
+	{
+		uint64_t userData;
+		int result;
+
+		while (pRing && pRing->PopCqe(userData, result))
+		{
+			if ((userData & IO_BATCH_OPEN_FLAG) && result >= 0)
+				close(result);
+		}
+	}
+
+	std::unique_ptr<CIOUring> pRing;
+	std::vector<char> statBuffers;
+};
+
+static thread_local std::vector<RetiredRing_t> s_retiredRings;
+
+static CIOUring* GetThreadRing()
+{
+	if (!s_pThreadRing)
+	{
+		std::unique_ptr<CIOUring> pRing(new CIOUring);
+
+		if (!pRing->Init(IO_BATCH_RING_ENTRIES))
+			return nullptr;
+
+		s_pThreadRing = std::move(pRing);
+	}
+
+	return s_pThreadRing.get();
+}
+#endif // __linux__
+
+//-----------------------------------------------------------------------------
+// Purpose: returns whether the platform supports async batches; only probed
+//			once, as a kernel that refuses io_uring keeps doing so
+//-----------------------------------------------------------------------------
+bool CIOBatch::IsAsyncAvailable()
+{
+#ifdef __linux__
+	static const bool s_isAvailable = []()
+	{
+		CIOUring ring;
+		return ring.Init(1);
+	}();
+
+	return s_isAvailable;
+#else
+	return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CIOBatch constructor
+// Input  : allowAsync - false to always use the blocking calls
+//-----------------------------------------------------------------------------
+CIOBatch::CIOBatch(const bool allowAsync)
+{
+	m_numSubmitted = 0;
+	m_allowAsync = allowAsync && IsAsyncAvailable();
+}
+
+size_t CIOBatch::AddOp(const OpType_t type)
+{
+	Op_t op;
+	op.type = type;
+	op.pDirectory = nullptr;
+	op.pFile = nullptr;
+	op.pFileSize = nullptr;
+	op.completed = false;
+	op.succeeded = false;
+
+	m_ops.push_back(std::move(op));
+	return m_ops.size() - 1;
+}
+
+size_t CIOBatch::AddOpen(const std::string& filePath, CNativeFile& file)
+{
+	const size_t opIdx = AddOp(OP_OPEN);
+	m_ops[opIdx].filePath = filePath;
+	m_ops[opIdx].pFile = &file;
+
+	return opIdx;
+}
+
+size_t CIOBatch::AddOpen(const CNativeDirectory& directory, const std::string& fileName, CNativeFile& file)
+{
+	const size_t opIdx = AddOpen(fileName, file);
+	m_ops[opIdx].pDirectory = &directory;
+
+	return opIdx;
+}
+
+size_t CIOBatch::AddStat(const std::string& filePath, uint64_t& fileSize)
+{
+	const size_t opIdx = AddOp(OP_STAT);
+	m_ops[opIdx].filePath = filePath;
+	m_ops[opIdx].pFileSize = &fileSize;
+
+	return opIdx;
+}
+
+void CIOBatch::ExecuteBlocking(Op_t& op)
+{
+	switch (op.type)
+	{
+	case OP_OPEN:
+	{
+		op.succeeded = op.pDirectory
+			? op.pDirectory->OpenFile(op.filePath, *op.pFile, CNativeFile::READ)
+			: op.pFile->Open(op.filePath, CNativeFile::READ);
+		break;
+	}
+	case OP_STAT:
+	{
+		std::error_code ec;
+		const uintmax_t fileSize = std::filesystem::file_size(op.filePath, ec);
+
+		if (!ec)
+			*op.pFileSize = uint64_t(fileSize);
+
+		op.succeeded = !ec;
+		break;
+	}
+	}
+
+	op.completed = true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: submits the pending operations through io_uring
+// Output : false if the ring couldn't be used, the remaining operations have
+//			to be executed by the caller then
+//-----------------------------------------------------------------------------
+bool CIOBatch::SubmitAsync()
+{
+#ifdef __linux__
+	CIOUring* const pRing = GetThreadRing();
+
+	if (!pRing)
+		return false;
+
+	const size_t numOps = m_ops.size();
+	m_statBuffers.resize(numOps * sizeof(struct statx));
+
+	struct statx* const pStatBuffers = reinterpret_cast<struct statx*>(m_statBuffers.data());
+
+	while (m_numSubmitted < numOps)
+	{
+		const size_t roundStart = m_numSubmitted;
+		unsigned numInFlight = 0;
+
+		for (; m_numSubmitted < numOps; m_numSubmitted++)
+		{
+			Op_t& op = m_ops[m_numSubmitted];
+			io_uring_sqe* const pSqe = pRing->GetSqe();
+
+			if (!pSqe)
+				break;
+
+			pSqe->user_data = m_numSubmitted;
+
+			switch (op.type)
+			{
+			case OP_OPEN:
+				pSqe->user_data |= IO_BATCH_OPEN_FLAG;
+				pSqe->opcode = IORING_OP_OPENAT;
+				pSqe->fd = op.pDirectory ? op.pDirectory->GetHandle() : AT_FDCWD;
+				pSqe->addr = uint64_t(uintptr_t(op.filePath.c_str()));
+				pSqe->open_flags = O_RDONLY | O_CLOEXEC;
+				break;
+			case OP_STAT:
+				pSqe->opcode = IORING_OP_STATX;
+				pSqe->fd = AT_FDCWD;
+				pSqe->addr = uint64_t(uintptr_t(op.filePath.c_str()));
+				pSqe->len = STATX_SIZE;
+				pSqe->off = uint64_t(uintptr_t(&pStatBuffers[m_numSubmitted]));
+				break;
+			}
+
+			numInFlight++;
+		}
+
+		// a failure shows up in the reap loop, which submits whatever the
+		// kernel hasn't consumed yet again
+		bool submitted = pRing->Submit(numInFlight);
+
+		while (numInFlight)
+		{
+			uint64_t userData;
+			int result;
+
+			if (submitted && !pRing->PopCqe(userData, result))
+				submitted = false;
+
+			if (!submitted)
+			{
+				if (pRing->Submit(numInFlight))
+				{
+					submitted = true;
+					continue;
+				}
+
+				if (errno == EAGAIN || errno == EBUSY)
+				{
+					// out of kernel resources for the moment, wait again
+					std::this_thread::yield();
+					continue;
+				}
+
+				AbandonRound(roundStart, pRing->GetNumUnsubmitted());
+				return false;
+			}
+
+			numInFlight--;
+			const size_t opIdx = size_t(userData & ~IO_BATCH_OPEN_FLAG);
+			Op_t& op = m_ops[opIdx];
+			op.completed = true;
+
+			switch (op.type)
+			{
+			case OP_OPEN:
+				if (result >= 0)
+					op.pFile->Attach(result, CNativeFile::READ);
+
+				op.succeeded = result >= 0;
+				break;
+			case OP_STAT:
+				if (result >= 0)
+					*op.pFileSize = pStatBuffers[opIdx].stx_size;
+
+				op.succeeded = result >= 0;
+				break;
+			}
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: gives up on the ring after it failed with operations in flight
+//
+// The ring is retired (see RetiredRing_t) rather than closed, so opens that
+// complete later don't leak their fds. Opens still in flight are marked as
+// failed instead of being redone, they may still succeed in the kernel; the
+// callers open the file themselves then. Stats are simply redone blocking, as
+// are the operations the kernel never got.
+//-----------------------------------------------------------------------------
+void CIOBatch::AbandonRound(const size_t roundStart, const size_t numUnsubmitted)
+{
+#ifdef __linux__
+	const size_t kernelEnd = m_numSubmitted - numUnsubmitted;
+
+	for (size_t i = roundStart; i < kernelEnd; i++)
+	{
+		Op_t& op = m_ops[i];
+
+		if (!op.completed && op.type == OP_OPEN)
+		{
+			op.completed = true;
+			op.succeeded = false;
+		}
+	}
+
+	s_retiredRings.emplace_back(std::move(s_pThreadRing), std::move(m_statBuffers));
+	m_numSubmitted = roundStart;
+#endif
+}
+
+void CIOBatch::Submit()
+{
+	if (m_allowAsync && SubmitAsync())
+		return;
+
+	for (; m_numSubmitted < m_ops.size(); m_numSubmitted++)
+	{
+		Op_t& op = m_ops[m_numSubmitted];
+
+		if (!op.completed)
+			ExecuteBlocking(op);
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "nativefile.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: set of independent file opens and stats that are submitted
+//			together
+//
+// On Linux the batch goes through io_uring, so it costs a handful of syscalls
+// no matter how many operations it holds, and the kernel works on all of them
+// at once. Where io_uring isn't available (other platforms, old kernels, or
+// disabled by policy) or async I/O isn't allowed, the operations are simply
+// executed one after another with the regular blocking calls.
+//
+// Lump data doesn't go through batches: transformed lumps are memory-mapped and
+// pass-through lumps are copied file to file in the kernel, so what is left
+// to batch are the metadata round trips.
+//
+// Everything passed to the Add functions has to stay alive until Submit has
+// returned. Operations in a batch may complete in any order, so they must not
+// depend on each other.
+//-----------------------------------------------------------------------------
+class CIOBatch
+{
+public:
+	CIOBatch(const bool allowAsync);
+
+	size_t AddOpen(const std::string& filePath, CNativeFile& file); // opens for reading
+	size_t AddOpen(const CNativeDirectory& directory, const std::string& fileName, CNativeFile& file);
+	size_t AddStat(const std::string& filePath, uint64_t& fileSize);
+
+	// executes all operations that have been added, returns once all of them
+	// have completed
+	void Submit();
+
+	inline size_t GetNumOps() const { return m_ops.size(); }
+	inline bool Succeeded(const size_t nOpIdx) const { return m_ops[nOpIdx].succeeded; }
+
+	static bool IsAsyncAvailable();
+
+private:
+	enum OpType_t
+	{
+		OP_OPEN,
+		OP_STAT,
+	};
+
+	struct Op_t
+	{
+		OpType_t type;
+		std::string filePath; // open and stat
+		const CNativeDirectory* pDirectory; // open, filePath is relative to it if set
+		CNativeFile* pFile;
+		uint64_t* pFileSize; // stat
+		bool completed;
+		bool succeeded;
+	};
+
+	size_t AddOp(const OpType_t type);
+
+	void ExecuteBlocking(Op_t& op);
+	bool SubmitAsync();
+	void AbandonRound(const size_t roundStart, const size_t numUnsubmitted);
+
+	std::vector<Op_t> m_ops;
+	// statx results of the async path, owned by the batch rather than by
+	// SubmitAsync as the kernel may still write to them after a failed wait
+	std::vector<char> m_statBuffers;
+	size_t m_numSubmitted;
+	bool m_allowAsync;
+};
@@ -0,0 +1,157 @@
+#include "stdafx.h"
+#include "lumpinventory.h"
+#include "bspfile.h"
+#include "stltools.h"
+
+// e.g. mp_rr_box.bsp.007f.bsp_lump, after the name of the bsp
+#define LUMP_FILE_SUFFIX_LEN (sizeof(".0000.bsp_lump") - 1)
+
+//-----------------------------------------------------------------------------
+// Purpose: parses the lump index out of a lump file name
+// Input  : name -
+//			&bspName - file name of the bsp
+//			&lumpIdx -
+// Output : true if the name is one of the bsp's lumps
+//-----------------------------------------------------------------------------
+static bool ParseLumpFileName(const std::string_view name, const std::string& bspName, int& lumpIdx)
+{
+	if (name.size() != bspName.size() + LUMP_FILE_SUFFIX_LEN ||
+		name.compare(0, bspName.size(), bspName) != 0 ||
+		name[bspName.size()] != '.' ||
+		name.compare(bspName.size() + 5, std::string_view::npos, ".bsp_lump") != 0)
+	{
+		return false;
+	}
+
+	lumpIdx = 0;
+
+	for (size_t i = bspName.size() + 1; i < bspName.size() + 5; i++)
+	{
+		const char c = name[i];
+		int digit;
+
+		if (c >= '0' && c <= '9')
+			digit = c - '0';
+		else if (c >= 'a' && c <= 'f')
+			digit = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			digit = c - 'A' + 10;
+		else
+			return false;
+
+		lumpIdx = (lumpIdx << 4) | digit;
+	}
+
+	return lumpIdx < LUMP_COUNT;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: lists the map's directory and records the files belonging to it
+// Input  : &bspPath -
+// Output : true on success, false if the directory couldn't be listed
+//-----------------------------------------------------------------------------
+bool CLumpInventory::Scan(const std::string& bspPath)
+{
+	TIME_SCOPE_DETAIL("ScanLumpDirectory", bspPath);
+
+	const fs::path bspFilePath(bspPath);
+	const std::string bspName = bspFilePath.filename().string();
+
+	const fs::path directoryPath = bspFilePath.parent_path().empty() ? fs::path(".") : bspFilePath.parent_path();
+
+	m_mapName = RemoveExtension(bspName);
+	m_directoryPath.clear();
+	m_lumpEntries.assign(LUMP_COUNT, -1);
+	m_entries.clear();
+
+	if (!m_directory.Open(directoryPath))
+		return false;
+
+	// partitions of this map are named "<map>_<partition>.ent"; another map
+	// may start with the same name, those are filtered out by the lookup
+	const std::string partitionPrefix = m_mapName + '_';
+	int lumpIdx;
+
+	const auto isMapFile = [&](const std::string_view name)
+	{
+		if (ParseLumpFileName(name, bspName, lumpIdx))
+			return true;
+
+		return name.size() > partitionPrefix.size() + 4 &&
+			name.compare(0, partitionPrefix.size(), partitionPrefix) == 0 &&
+			name.compare(name.size() - 4, 4, ".ent") == 0;
+	};
+
+	if (!m_directory.List(isMapFile, m_entries))
+	{
+		m_directory.Close();
+		return false;
+	}
+
+	for (size_t i = 0; i < m_entries.size(); i++)
+	{
+		if (ParseLumpFileName(m_entries[i].name, bspName, lumpIdx))
+			m_lumpEntries[lumpIdx] = int(i);
+	}
+
+	m_directoryPath = directoryPath;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: reopens the directory, relative opens go through it again
+// Output : true on success, false if it hasn't been listed or can't be opened
+//-----------------------------------------------------------------------------
+bool CLumpInventory::OpenDirectory()
+{
+	if (m_directoryPath.empty())
+		return false;
+
+	return m_directory.IsOpen() || m_directory.Open(m_directoryPath);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: updates the sizes and times of the listed files
+// Output : true on success, false if the directory hasn't been listed or a
+//			file is gone
+//-----------------------------------------------------------------------------
+bool CLumpInventory::Refresh()
+{
+	if (!OpenDirectory())
+		return false;
+
+	for (Entry_t& entry : m_entries)
+	{
+		if (!m_directory.Stat(entry.name, entry.size, entry.mtime))
+			return false;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: finds the file of a lump
+//-----------------------------------------------------------------------------
+const CLumpInventory::Entry_t* CLumpInventory::FindLump(const int lumpIdx) const
+{
+	if (lumpIdx < 0 || size_t(lumpIdx) >= m_lumpEntries.size() || m_lumpEntries[lumpIdx] < 0)
+		return nullptr;
+
+	return &m_entries[size_t(m_lumpEntries[lumpIdx])];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: finds the file of an entity partition
+//-----------------------------------------------------------------------------
+const CLumpInventory::Entry_t* CLumpInventory::FindEntityPartition(const std::string& partitionName) const
+{
+	const std::string fileName = Format("%s_%s.ent", m_mapName.c_str(), partitionName.c_str());
+
+	for (const Entry_t& entry : m_entries)
+	{
+		if (entry.name == fileName)
+			return &entry;
+	}
+
+	return nullptr;
+}
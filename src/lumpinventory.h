@@ -0,0 +1,45 @@
+#pragma once
+#include "nativefile.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: the lump and entity partition files of a map, found by listing the
+//			map's directory once
+//
+// Replaces probing every lump of the header on its own (exists, size, open),
+// which on network file systems costs more in metadata round trips than reading
+// the data. Files are opened relative to the directory handle.
+//-----------------------------------------------------------------------------
+class CLumpInventory
+{
+public:
+	typedef CNativeDirectory::Entry_t Entry_t;
+
+	CLumpInventory() {}
+
+	bool Scan(const std::string& bspPath);
+	// queries the listed files again, e.g. after the conversion rewrote some
+	// of them, without listing the directory; reopens it if it was closed
+	bool Refresh();
+	// releases the directory handle, the listing is kept
+	inline void CloseDirectory() { m_directory.Close(); }
+	// opens the listed directory again after CloseDirectory
+	bool OpenDirectory();
+
+	// nullptr if the lump has no file
+	const Entry_t* FindLump(const int lumpIdx) const;
+	// partitionName as stored in the partition lump, e.g. "env"
+	const Entry_t* FindEntityPartition(const std::string& partitionName) const;
+
+	inline bool OpenFile(const Entry_t& entry, CNativeFile& file, const int nFlags) const { return m_directory.OpenFile(entry.name, file, nFlags); }
+
+	inline bool IsValid() const { return m_directory.IsOpen(); }
+	inline const CNativeDirectory& GetDirectory() const { return m_directory; }
+
+private:
+	CNativeDirectory m_directory;
+	fs::path m_directoryPath; // empty unless the directory has been listed
+	std::string m_mapName; // file name of the bsp without extension
+
+	std::vector<int> m_lumpEntries; // lump index to m_entries index, -1 if missing
+	std::vector<Entry_t> m_entries;
+};
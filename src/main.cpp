@@ -6,15 +6,28 @@
 #include <bspfile.h>
 #include <rmem.h>
 #include <versions.h>
+#include <threadpool.h>
+#include <manifest.h>
+#include <outputset.h>
+#include <trace.h>
+#include <allocprofile.h>
+#include <stats.h>
+#include <bspinfo.h>
+#include <nativefile.h>
+#include <lumpinventory.h>
+#include <stltools.h>
 #include <filesystem>
 #include <vector>
+#include <condition_variable>
+#include <mutex>
 #include <iostream>
 #include <algorithm>
+#include <memory>
 
 namespace fs = std::filesystem;
 
 // Function to scan recursively for .bsp files
-std::vector<std::string> FindBspFiles(const std::string& directory = ".")
+std::vector<std::string> FindBspFiles(const std::string& directory = ".", const bool printFound = true)
 {
     std::vector<std::string> bspFiles;
     
@@ -42,7 +55,8 @@ std::vector<std::string> FindBspFiles(const std::string& directory = ".")
                 if (extension == ".bsp")
                 {
                     bspFiles.push_back(fullPath);
-                    printf("Found BSP file: %s\n", fullPath.c_str());
+                    if (printFound)
+                        printf("Found BSP file: %s\n", fullPath.c_str());
                 }
             }
         }
@@ -55,63 +69,6 @@ std::vector<std::string> FindBspFiles(const std::string& directory = ".")
     return bspFiles;
 }
 
-// Function to replace ALL .new files in a directory with their originals
-bool ReplaceNewFilesInDirectory(const std::string& directory)
-{
-    bool success = true;
-    int filesReplaced = 0;
-    
-    try
-    {
-        for (const auto& entry : fs::directory_iterator(directory))
-        {
-            if (entry.is_regular_file())
-            {
-                std::string filename = entry.path().filename().string();
-                
-                // Check if this is a .new file
-                if (filename.length() > 4 && filename.substr(filename.length() - 4) == ".new")
-                {
-                    fs::path newFilePath = entry.path();
-                    std::string originalFilename = filename.substr(0, filename.length() - 4); // Remove .new extension
-                    fs::path originalFilePath = fs::path(directory) / originalFilename;
-                    
-                    try
-                    {
-                        // Delete original file if it exists
-                        if (fs::exists(originalFilePath))
-                        {
-                            fs::remove(originalFilePath);
-                        }
-                        
-                        // Rename .new file to original name
-                        fs::rename(newFilePath, originalFilePath);
-                        printf("Replaced: %s -> %s\n", filename.c_str(), originalFilename.c_str());
-                        filesReplaced++;
-                    }
-                    catch (const fs::filesystem_error& ex)
-                    {
-                        printf("Error replacing file %s: %s\n", filename.c_str(), ex.what());
-                        success = false;
-                    }
-                }
-            }
-        }
-        
-        if (filesReplaced > 0)
-        {
-            printf("Successfully replaced %d files in %s\n", filesReplaced, directory.c_str());
-        }
-    }
-    catch (const fs::filesystem_error& ex)
-    {
-        printf("Error accessing directory %s: %s\n", directory.c_str(), ex.what());
-        success = false;
-    }
-    
-    return success;
-}
-
 // Function to replace original files with .new versions in a directory
 bool ReplaceWithNewFiles(const std::string& directory = ".")
 {
@@ -168,20 +125,29 @@ bool ReplaceWithNewFiles(const std::string& directory = ".")
 }
 
 // Function to process a single BSP file
-bool ProcessSingleBsp(const std::string& bspPath, bool shouldPack)
+// Every file written is recorded in outputs, they are removed again if the map fails
+// What the conversion did is recorded in pStats if set, pInventory is the map's listing if there is one
+bool ProcessSingleBsp(const std::string& bspPath, const ConvertOptions_t& convertOptions, COutputSet& outputs, MapStats_t* const pStats, const CLumpInventory* const pInventory)
 {
-    printf("\n=== Processing: %s ===\n", bspPath.c_str());
+    TIME_SCOPE_DETAIL("ConvertMap", bspPath);
+
+    const int64_t startTime = CScopeTimer::GetTime();
+
+    if (pStats)
+        pStats->path = bspPath;
+
+    Msg("\n=== Processing: %s ===\n", bspPath.c_str());
     
     if (!FILE_EXISTS(bspPath.c_str()))
     {
-        printf("ERROR: File not found: %s\n", bspPath.c_str());
+        Msg("ERROR: File not found: %s\n", bspPath.c_str());
         return false;
     }
     
     CIOStream bspIn;
-    if (!bspIn.Open(bspPath, CIOStream::READ | CIOStream::BINARY))
+    if (!bspIn.Open(bspPath, CIOStream::READ | CIOStream::BINARY | CIOStream::MMAP))
     {
-        printf("ERROR: Failed to open BSP file: %s\n", bspPath.c_str());
+        Msg("ERROR: Failed to open BSP file: %s\n", bspPath.c_str());
         return false;
     }
     
@@ -189,37 +155,98 @@ bool ProcessSingleBsp(const std::string& bspPath, bool shouldPack)
     
     if (fileSize < sizeof(BSPHeader_t))
     {
-        printf("ERROR: Input file is too small (must be at least 0x%x bytes): %s\n", 
+        Msg("ERROR: Input file is too small (must be at least 0x%x bytes): %s\n", 
                sizeof(BSPHeader_t), bspPath.c_str());
         return false;
     }
     
-    // Read full BSP file into buffer
-    char* const buf = new char[fileSize];
-    bspIn.Read(buf, fileSize);
+    // The BSP is mapped copy-on-write, so the header can be patched in place
+    // without reading the file or modifying it on disk
+    char* const buf = bspIn.GetMappedData();
     
     try
     {
-        ConvertBSP(bspPath, buf, shouldPack);
-        delete[] buf;
-        printf("SUCCESS: Converted %s\n", bspPath.c_str());
+        ConvertBSP(bspPath, buf, convertOptions, outputs, pStats, pInventory);
+        Msg("SUCCESS: Converted %s\n", bspPath.c_str());
+
+        if (pStats)
+        {
+            pStats->converted = true;
+            pStats->timeNs = uint64_t(CScopeTimer::GetTime() - startTime);
+        }
+
         return true;
     }
+    catch (const CConvertError& error)
+    {
+        outputs.Discard();
+        Msg("ERROR: %s", error.what());
+        Msg("ERROR: Failed to convert %s\n", bspPath.c_str());
+
+        if (pStats)
+            pStats->timeNs = uint64_t(CScopeTimer::GetTime() - startTime);
+
+        return false;
+    }
     catch (...)
     {
-        delete[] buf;
-        printf("ERROR: Failed to convert %s\n", bspPath.c_str());
+        outputs.Discard();
+        Msg("ERROR: Failed to convert %s\n", bspPath.c_str());
+
+        if (pStats)
+            pStats->timeNs = uint64_t(CScopeTimer::GetTime() - startTime);
+
         return false;
     }
 }
 
+// Estimates how much memory converting a map takes, only reads its header
+// May be called from multiple threads at once
+size_t EstimateMapMemory(const std::string& bspPath, const ConvertOptions_t& convertOptions)
+{
+    TIME_SCOPE_DETAIL("EstimateMemory", bspPath);
+
+    BSPHeader_t header = {};
+
+    CNativeFile bspIn;
+    if (bspIn.Open(bspPath, CNativeFile::READ))
+        bspIn.ReadAt(&header, sizeof(header), 0);
+
+    return EstimateConvertMemory(reinterpret_cast<const char*>(&header), convertOptions);
+}
+
+// Options for batch conversion
+struct BatchOptions_t
+{
+    ConvertOptions_t convert;
+    size_t numJobs;      // Number of maps converted concurrently
+    size_t memoryBudget; // Bytes the estimated memory of all running maps must stay within, 0 = unlimited
+    bool incremental;    // Skip maps whose manifest says they are up to date
+    bool syncOutputs;    // Flush the converted files to disk before and after they are committed
+    std::string statsPath; // Write the stats of the converted maps as JSON here, empty = off
+};
+
+enum BatchResult_t
+{
+    BATCH_FAILED = 0,
+    BATCH_CONVERTED,
+    BATCH_UP_TO_DATE,
+};
+
 // Function to perform batch conversion
-bool BatchConvert(bool shouldPack)
+bool BatchConvert(const BatchOptions_t& options)
 {
+    const bool shouldPack = options.convert.packAllLumps;
+    const int64_t startTime = CScopeTimer::GetTime();
+
     printf("\n=== RECURSIVE BATCH CONVERSION MODE ===\n");
     printf("Scanning recursively for .bsp files...\n\n");
     
-    std::vector<std::string> bspFiles = FindBspFiles();
+    std::vector<std::string> bspFiles;
+    {
+        TIME_SCOPE("ScanForBsps");
+        bspFiles = FindBspFiles();
+    }
     
     if (bspFiles.empty())
     {
@@ -227,68 +254,482 @@ bool BatchConvert(bool shouldPack)
         return true; // Not an error
     }
     
-    printf("\nFound %zu .bsp file(s). Starting recursive batch conversion...\n", bspFiles.size());
-    
+    const size_t numJobs = std::min(options.numJobs, bspFiles.size());
+
+    printf("\nFound %zu .bsp file(s). Starting recursive batch conversion with %zu job(s)...\n", bspFiles.size(), numJobs);
+
     int successCount = 0;
     int failureCount = 0;
     int replacedCount = 0;
+    int upToDateCount = 0;
     
-    // Process each BSP file
+    std::vector<BatchResult_t> results(bspFiles.size(), BATCH_FAILED);
+    std::vector<COutputSet> outputSets(bspFiles.size());
+    std::vector<std::unique_ptr<MapStats_t>> mapStats(bspFiles.size()); // only with -stats
+    // Each map's directory is listed once, for the manifest check, the
+    // conversion and the new manifest; kept for the maps that are converted
+    std::vector<std::unique_ptr<CLumpInventory>> inventories(bspFiles.size());
+    std::vector<char> replaced(bspFiles.size(), false);
+    std::mutex outputMutex;
+    size_t numFinished = 0;
+
+    // The calling thread only schedules, the maps run on the pool
+    CThreadPool pool(numJobs);
+    CTaskGroup group;
+
+    // Check the manifest of every map and estimate the memory of the ones that
+    // have to be converted from their header, on the pool; then start the
+    // largest maps first so a big one doesn't end up running alone at the end
+    std::vector<size_t> memoryEstimates(bspFiles.size());
+    std::vector<char> started(bspFiles.size(), false);
+    std::vector<size_t> order;
+
     for (size_t i = 0; i < bspFiles.size(); ++i)
     {
-        const std::string& bspFile = bspFiles[i];
-        printf("\n[%zu/%zu] ", i + 1, bspFiles.size());
-        
-        if (ProcessSingleBsp(bspFile, shouldPack))
+        pool.Submit(group, [&, i]()
+        {
+            const std::string& bspFile = bspFiles[i];
+
+            std::unique_ptr<CLumpInventory> inventory(new CLumpInventory);
+            inventory->Scan(bspFile);
+
+            if (options.incremental)
+            {
+                TIME_SCOPE_DETAIL("CheckManifest", bspFile);
+                CConversionManifest manifest;
+
+                if (manifest.Load(bspFile) && manifest.IsUpToDate(bspFile, *inventory, shouldPack))
+                {
+                    results[i] = BATCH_UP_TO_DATE;
+                    started[i] = true;
+
+                    std::lock_guard<std::mutex> lock(outputMutex);
+                    printf("\n[%zu/%zu] \n=== Up to date, skipping: %s ===\n", numJobs > 1 ? ++numFinished : i + 1, bspFiles.size(), bspFile.c_str());
+                    return;
+                }
+            }
+
+            memoryEstimates[i] = EstimateMapMemory(bspFile, options.convert);
+
+            // Only the listing is kept until the map runs, not one open
+            // directory per map
+            inventory->CloseDirectory();
+            inventories[i] = std::move(inventory);
+        });
+    }
+
+    pool.Wait(group);
+
+    for (size_t i = 0; i < bspFiles.size(); ++i)
+    {
+        if (!started[i])
+            order.push_back(i);
+    }
+
+    if (numJobs > 1)
+    {
+        std::stable_sort(order.begin(), order.end(),
+            [&memoryEstimates](const size_t a, const size_t b) { return memoryEstimates[a] > memoryEstimates[b]; });
+    }
+    
+    // Scheduler state, the calling thread starts maps as running ones finish
+    std::mutex scheduleMutex;
+    std::condition_variable finishedCond;
+    std::vector<char> heldBack(bspFiles.size(), false);
+    std::vector<size_t> overBudget;
+    size_t numRunning = 0;
+    size_t memoryInUse = 0;
+    size_t peakMemoryInUse = 0;
+
+    // Entity partitions of the maps are converted on the same pool
+    g_pThreadPool = &pool;
+
+    // Start the maps in order as long as the estimated memory of all running
+    // maps stays within the budget. If the next map doesn't fit, the largest
+    // one after it that does is started instead; a map that doesn't fit even
+    // on its own is started once nothing else is running
+    std::unique_lock<std::mutex> scheduleLock(scheduleMutex);
+
+    for (size_t numStarted = bspFiles.size() - order.size(); numStarted < bspFiles.size();)
+    {
+        size_t pick = SIZE_MAX;
+
+        if (numRunning < numJobs)
+        {
+            bool isFirst = true;
+
+            for (const size_t candidate : order)
+            {
+                if (started[candidate])
+                    continue;
+
+                if (!options.memoryBudget || memoryInUse + memoryEstimates[candidate] <= options.memoryBudget)
+                {
+                    pick = candidate;
+                    break;
+                }
+
+                if (isFirst && numRunning == 0)
+                {
+                    overBudget.push_back(candidate);
+                    pick = candidate;
+                    break;
+                }
+
+                if (isFirst)
+                    heldBack[candidate] = true;
+
+                isFirst = false;
+            }
+        }
+
+        if (pick == SIZE_MAX)
+        {
+            finishedCond.wait(scheduleLock);
+            continue;
+        }
+
+        started[pick] = true;
+        numStarted++;
+        numRunning++;
+        memoryInUse += memoryEstimates[pick];
+        peakMemoryInUse = std::max(peakMemoryInUse, memoryInUse);
+
+        const size_t i = pick;
+
+        pool.Submit(group, [&, i]()
+        {
+            const std::string& bspFile = bspFiles[i];
+
+            // Buffer the output of each map when running in parallel so it
+            // doesn't interleave with the other maps
+            std::string output;
+            CScopedMsgBuffer msgBuffer(numJobs > 1 ? &output : nullptr);
+
+            if (numJobs == 1)
+                printf("\n[%zu/%zu] ", i + 1, bspFiles.size());
+
+            CLumpInventory& inventory = *inventories[i];
+            inventory.OpenDirectory();
+
+            if (!options.statsPath.empty())
+                mapStats[i].reset(new MapStats_t);
+
+            results[i] = ProcessSingleBsp(bspFile, options.convert, outputSets[i], mapStats[i].get(), &inventory) ? BATCH_CONVERTED : BATCH_FAILED;
+
+            // Only the listing is needed until the manifest is built
+            inventory.CloseDirectory();
+
+            if (results[i] != BATCH_CONVERTED)
+                inventories[i].reset();
+
+            if (numJobs > 1)
+            {
+                std::lock_guard<std::mutex> lock(outputMutex);
+                printf("\n[%zu/%zu] %s", ++numFinished, bspFiles.size(), output.c_str());
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(scheduleMutex);
+                numRunning--;
+                memoryInUse -= memoryEstimates[i];
+            }
+            finishedCond.notify_one();
+        });
+    }
+
+    scheduleLock.unlock();
+
+    pool.Wait(group);
+    g_pThreadPool = nullptr;
+
+    // Commit the files each map has written once every map has finished; all
+    // of them are flushed together first, instead of one flush per file
+    std::vector<const COutputSet*> convertedSets;
+
+    for (size_t i = 0; i < bspFiles.size(); ++i)
+    {
+        if (results[i] == BATCH_CONVERTED)
+            convertedSets.push_back(&outputSets[i]);
+    }
+
+    if (options.syncOutputs)
+    {
+        TIME_SCOPE("SyncFiles");
+        COutputSet::SyncFiles(convertedSets);
+    }
+
+    for (size_t i = 0; i < bspFiles.size(); ++i)
+    {
+        if (results[i] == BATCH_CONVERTED)
         {
             successCount++;
-            // Get the directory containing the BSP file and replace ALL .new files there
-            std::string bspDirectory = fs::path(bspFile).parent_path().string();
-            printf("Replacing .new files in: %s\n", bspDirectory.c_str());
-            if (ReplaceNewFilesInDirectory(bspDirectory))
+            printf("Replacing %zu .new file(s) of: %s\n", outputSets[i].GetNumFiles(), bspFiles[i].c_str());
+            TIME_SCOPE_DETAIL("CommitOutputs", bspFiles[i]);
+            if (outputSets[i].Commit())
             {
                 replacedCount++;
+                replaced[i] = true;
             }
         }
+        else if (results[i] == BATCH_UP_TO_DATE)
+        {
+            upToDateCount++;
+        }
         else
         {
             failureCount++;
         }
     }
+
+    if (options.syncOutputs)
+    {
+        TIME_SCOPE("SyncDirectories");
+        COutputSet::SyncDirectories(convertedSets);
+    }
+
+    // Record the converted files so the next run can skip these maps
+    for (size_t i = 0; i < bspFiles.size(); ++i)
+    {
+        if (!replaced[i])
+            continue;
+
+        pool.Submit(group, [&, i]()
+        {
+            TIME_SCOPE_DETAIL("BuildManifest", bspFiles[i]);
+
+            // Files the conversion didn't rewrite keep the hash they had
+            CConversionManifest previous;
+            const bool hasPrevious = previous.Load(bspFiles[i]);
+
+            CConversionManifest manifest;
+            if (!manifest.Build(bspFiles[i], *inventories[i], shouldPack, hasPrevious ? &previous : nullptr) || !manifest.Save(bspFiles[i]))
+            {
+                std::lock_guard<std::mutex> lock(outputMutex);
+                printf("Failed to write conversion manifest for %s\n", bspFiles[i].c_str());
+            }
+
+            inventories[i].reset();
+        });
+    }
+
+    pool.Wait(group);
     
     printf("\n=== RECURSIVE BATCH CONVERSION COMPLETE ===\n");
     printf("Total files found: %zu\n", bspFiles.size());
     printf("Successfully converted: %d\n", successCount);
     printf("Successfully replaced: %d\n", replacedCount);
+    printf("Skipped (up to date): %d\n", upToDateCount);
     printf("Failed conversions: %d\n", failureCount);
+
+    if (options.memoryBudget)
+        printf("Memory budget: %zu MiB\n", options.memoryBudget >> 20);
+    else
+        printf("Memory budget: unlimited\n");
+
+    printf("Peak estimated memory of running maps: %zu MiB\n", (peakMemoryInUse + (1 << 20) - 1) >> 20);
+
+    if (numJobs > 1)
+        printf("Start order: largest estimated memory first (%s, %zu MiB)\n", bspFiles[order[0]].c_str(), (memoryEstimates[order[0]] + (1 << 20) - 1) >> 20);
+
+    printf("Maps held back for memory: %zu\n", size_t(std::count(heldBack.begin(), heldBack.end(), true)));
+
+    for (const size_t i : overBudget)
+        printf("Over budget on its own (%zu MiB estimated), ran alone: %s\n", (memoryEstimates[i] + (1 << 20) - 1) >> 20, bspFiles[i].c_str());
+
+    if (!options.statsPath.empty())
+    {
+        // Maps that were up to date haven't been converted, so they have no stats
+        std::vector<const MapStats_t*> convertedStats;
+
+        for (const std::unique_ptr<MapStats_t>& stats : mapStats)
+        {
+            if (stats)
+                convertedStats.push_back(stats.get());
+        }
+
+        WriteStatsReport(options.statsPath, convertedStats, uint64_t(CScopeTimer::GetTime() - startTime));
+    }
     
     return failureCount == 0;
 }
 
+// Reads only the header of one map or of every map under a directory, and
+// checks its lumps against the files on disk; nothing is converted
+bool InspectBsps(const std::string& target, const std::string& jsonPath, const size_t numJobs)
+{
+    std::vector<std::string> bspFiles;
+
+    if (fs::is_directory(target))
+    {
+        TIME_SCOPE("ScanForBsps");
+        bspFiles = FindBspFiles(target, false);
+        std::sort(bspFiles.begin(), bspFiles.end());
+    }
+    else
+    {
+        bspFiles.push_back(target);
+    }
+
+    if (bspFiles.empty())
+    {
+        printf("No .bsp files found in \"%s\".\n", target.c_str());
+        return true; // Not an error
+    }
+
+    std::vector<BspInfo_t> infos(bspFiles.size());
+
+    {
+        // The calling thread reads headers too while it waits
+        CThreadPool pool(std::min(numJobs, bspFiles.size()) - 1);
+        CTaskGroup group;
+
+        for (size_t i = 0; i < bspFiles.size(); ++i)
+            pool.Submit(group, [&, i]() { ReadBspInfo(bspFiles[i], infos[i]); });
+
+        pool.Wait(group);
+    }
+
+    size_t numInvalid = 0;
+    size_t numWithProblems = 0;
+
+    for (const BspInfo_t& info : infos)
+    {
+        if (!info.valid)
+            numInvalid++;
+        else if (info.numProblems)
+            numWithProblems++;
+
+        // A single map gets its whole lump table, a tree only its problems
+        if (jsonPath.empty())
+            PrintBspInfo(info, bspFiles.size() == 1);
+    }
+
+    printf("\nInspected %zu map(s): %zu invalid, %zu with lump problems\n", bspFiles.size(), numInvalid, numWithProblems);
+
+    if (!jsonPath.empty())
+    {
+        std::string json = Format("{\n  \"numMaps\":%zu,\n  \"numInvalid\":%zu,\n  \"numWithProblems\":%zu,\n  \"maps\":[", bspFiles.size(), numInvalid, numWithProblems);
+
+        for (size_t i = 0; i < infos.size(); ++i)
+        {
+            json += i ? ",\n  " : "\n  ";
+            AppendBspInfoJson(json, infos[i]);
+        }
+
+        json += "\n  ]\n}\n";
+
+        CNativeFile out;
+        if (!out.Open(jsonPath, CNativeFile::WRITE) || !out.Write(json.data(), json.size()))
+        {
+            printf("Failed to write map info \"%s\"\n", jsonPath.c_str());
+            return false;
+        }
+
+        printf("Wrote map info to \"%s\"\n", jsonPath.c_str());
+    }
+
+    return numInvalid == 0 && numWithProblems == 0;
+}
+
 int main(int argc, char** argv)
 {
     printf("bspconv - Copyright (c) %s, rexx\n", &__DATE__[7]);
 
     const CommandLine cmdline(argc, argv);
 
+    // Record where the time goes and write it out as a Chrome trace at the end
+    const std::string tracePath = cmdline.GetParamValue("-trace", "");
+    if (!tracePath.empty())
+        CTraceRecorder::Start();
+
+    // Count heap allocations per phase and lump type
+    const std::string allocProfilePath = cmdline.GetParamValue("-allocprofile", "");
+    if (!allocProfilePath.empty())
+        CAllocProfiler::Start();
+
+    // Inspect headers only, for one map or a whole tree
+    if (cmdline.HasParam("-info"))
+    {
+        printf("\n");
+
+        // 0 = one job per hardware thread
+        int numJobs = atoi(cmdline.GetParamValue("-jobs", "0"));
+        if (numJobs <= 0)
+            numJobs = std::max(1, int(std::thread::hardware_concurrency()));
+
+        const bool success = InspectBsps(cmdline.GetParamValue("-info", "."), cmdline.GetParamValue("-json", ""), size_t(numJobs));
+
+        if (!tracePath.empty())
+            CTraceRecorder::Stop(tracePath);
+
+        if (!allocProfilePath.empty())
+            CAllocProfiler::Stop(allocProfilePath);
+
+        return success ? 0 : 1;
+    }
+
     // Check for batch mode
     if (cmdline.HasParam("-batch"))
     {
         printf("\n");
-        bool shouldPack = cmdline.HasParam("-pack") || cmdline.HasParam("1");
-        return BatchConvert(shouldPack) ? 0 : 1;
+        BatchOptions_t options;
+        // "-batch 1" is the old spelling of -pack; a bare "1" anywhere else is
+        // the value of some other option, e.g. -jobs 1
+        options.convert.packAllLumps = cmdline.HasParam("-pack") || strcmp(cmdline.GetParamValue("-batch", ""), "1") == 0;
+        options.convert.parallelWrite = cmdline.HasParam("-parallelwrite");
+        options.convert.asyncIO = cmdline.HasParam("-asyncio");
+        options.convert.prefetchWindow = size_t(std::max(0, atoi(cmdline.GetParamValue("-prefetch", "0"))));
+        options.convert.hugePages = cmdline.HasParam("-hugepages");
+        options.convert.memoryCap = size_t(std::max(0, atoi(cmdline.GetParamValue("-memcap", "0")))) << 20;
+        options.memoryBudget = size_t(std::max(0, atoi(cmdline.GetParamValue("-membudget", "0")))) << 20;
+        options.incremental = !cmdline.HasParam("-force");
+        options.syncOutputs = cmdline.HasParam("-sync");
+        options.statsPath = cmdline.GetParamValue("-stats", "");
+
+        // 0 = one job per hardware thread
+        int numJobs = atoi(cmdline.GetParamValue("-jobs", "1"));
+        if (numJobs <= 0)
+            numJobs = std::max(1, int(std::thread::hardware_concurrency()));
+
+        options.numJobs = size_t(numJobs);
+
+        const bool success = BatchConvert(options);
+
+        if (!tracePath.empty())
+            CTraceRecorder::Stop(tracePath);
+
+        if (!allocProfilePath.empty())
+            CAllocProfiler::Stop(allocProfilePath);
+
+        return success ? 0 : 1;
     }
 
     // Original single file mode
     if (argc < 2)
     {
         printf("\nUsage:\n");
-        printf("  Single file: bspconv <fileName> [shouldPack]\n");
-        printf("  Batch mode:  bspconv -batch [-pack]\n");
+        printf("  Single file: bspconv <fileName> [shouldPack] [-pack] [-parallelwrite] [-asyncio] [-prefetch N] [-hugepages] [-memcap MiB] [-trace out.json] [-stats out.json] [-allocprofile out.json]\n");
+        printf("  Batch mode:  bspconv -batch [-pack] [-jobs N] [-membudget MiB] [-force] [-sync] [-parallelwrite] [-asyncio] [-prefetch N] [-hugepages] [-memcap MiB] [-trace out.json] [-stats out.json] [-allocprofile out.json]\n");
+        printf("  Inspect:     bspconv -info [fileName|directory] [-json out.json] [-jobs N]\n");
         printf("\n");
         printf("Options:\n");
         printf("  -batch       Process all .bsp files recursively\n");
+        printf("  -info        Print the header and lump table of a map, or check every map under a directory (default .), without converting\n");
+        printf("  -json FILE   Write the -info results of all maps as JSON instead of printing them\n");
         printf("  -pack        Pack all lumps (optional, works in both modes)\n");
+        printf("  -jobs N      Number of maps to convert in parallel in batch mode, or to inspect with -info (0 = all cores)\n");
+        printf("  -membudget MiB Only run maps concurrently while their estimated memory fits in the budget (batch mode)\n");
+        printf("  -force       Convert all maps in batch mode, even if their manifest says they are up to date\n");
+        printf("  -sync        Flush the converted files to disk in one group before and after replacing the originals (batch mode)\n");
+        printf("  -parallelwrite Preallocate the packed BSP and write its lumps concurrently (packing only)\n");
+        printf("  -asyncio     Batch lump file opens and stats through io_uring (Linux, falls back to blocking I/O)\n");
+        printf("  -prefetch N  Issue readahead for the next N lumps while the current ones are converted (default 0 = off)\n");
+        printf("  -hugepages   Back the per-map lump memory with huge pages where the OS allows it\n");
+        printf("  -memcap MiB  Stream transformed lumps in pieces when packing, to keep a map's memory below the cap\n");
+        printf("  -trace FILE  Record where the time is spent and write it as a Chrome trace (chrome://tracing, Perfetto)\n");
+        printf("  -stats FILE  Write bytes, time and lump memory per lump type, per map and for the whole run as JSON\n");
+        printf("  -allocprofile FILE Count heap allocations, bytes and peak live bytes per phase and lump type and write them as JSON\n");
         printf("  shouldPack   1 to pack lumps (single file mode only)\n");
         printf("\n");
         Error("Invalid usage. See usage information above.\n");
@@ -300,7 +741,7 @@ int main(int argc, char** argv)
     const std::string bspPath = argv[1];
 
     CIOStream bspIn;
-    if (!bspIn.Open(bspPath, CIOStream::READ | CIOStream::BINARY))
+    if (!bspIn.Open(bspPath, CIOStream::READ | CIOStream::BINARY | CIOStream::MMAP))
         Error("failed to open BSP file \"%s\"\n", bspPath.c_str());
 
     const size_t fileSize = bspIn.GetSize();
@@ -308,11 +749,59 @@ int main(int argc, char** argv)
     if (fileSize < sizeof(BSPHeader_t))
         Error("input file is too small (must be at least 0x%x bytes\n", sizeof(BSPHeader_t));
 
-    // read full bsp file into buffer to pass to each version func
-    char* const buf = new char[fileSize];
-    bspIn.Read(buf, fileSize);
+    // map the bsp file copy-on-write to pass to each version func
+    char* const buf = bspIn.GetMappedData();
+
+    ConvertOptions_t options;
+    // shouldPack is the positional "1" after the file name, options don't count
+    options.packAllLumps = cmdline.HasParam("-pack") || (argc > 2 && strcmp(argv[2], "1") == 0);
+    options.parallelWrite = cmdline.HasParam("-parallelwrite");
+    options.asyncIO = cmdline.HasParam("-asyncio");
+    options.prefetchWindow = size_t(std::max(0, atoi(cmdline.GetParamValue("-prefetch", "0"))));
+    options.hugePages = cmdline.HasParam("-hugepages");
+    options.memoryCap = size_t(std::max(0, atoi(cmdline.GetParamValue("-memcap", "0")))) << 20;
+
+    // a single map has the whole machine to itself for its lumps and entity partitions
+    CThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    g_pThreadPool = &pool;
+
+    const std::string statsPath = cmdline.GetParamValue("-stats", "");
+    std::unique_ptr<MapStats_t> stats(statsPath.empty() ? nullptr : new MapStats_t);
+
+    if (stats)
+        stats->path = bspPath;
+
+    const int64_t startTime = CScopeTimer::GetTime();
+
+    // Single file mode leaves the .new files next to the originals
+    COutputSet outputs;
+
+    try
+    {
+        ConvertBSP(bspPath, buf, options, outputs, stats.get());
+    }
+    catch (const CConvertError& error)
+    {
+        // Don't leave a half converted map behind
+        outputs.Discard();
+        Error("%s", error.what());
+    }
+
+    g_pThreadPool = nullptr;
+
+    if (stats)
+    {
+        stats->converted = true;
+        stats->timeNs = uint64_t(CScopeTimer::GetTime() - startTime);
+
+        WriteStatsReport(statsPath, { stats.get() }, stats->timeNs);
+    }
+
+    if (!tracePath.empty())
+        CTraceRecorder::Stop(tracePath);
 
-    ConvertBSP(bspPath, buf, (argc > 2));
+    if (!allocProfilePath.empty())
+        CAllocProfiler::Stop(allocProfilePath);
     
     printf("\nConversion completed successfully.\n");
     return 0;
@@ -0,0 +1,319 @@
+#include "stdafx.h"
+#include "manifest.h"
+#include "nativefile.h"
+#include "stltools.h"
+#include "versions.h"
+#include "bspfile.h"
+#include "lumpinventory.h"
+
+// XXH64 primes
+#define HASH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME64_3 0x165667B19E3779F9ULL
+#define HASH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t HashRotl64(const uint64_t x, const int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t HashRound(uint64_t acc, const uint64_t input)
+{
+	acc += input * HASH_PRIME64_2;
+	acc = HashRotl64(acc, 31);
+	return acc * HASH_PRIME64_1;
+}
+
+static inline uint64_t HashMergeRound(uint64_t acc, const uint64_t val)
+{
+	acc ^= HashRound(0, val);
+	return acc * HASH_PRIME64_1 + HASH_PRIME64_4;
+}
+
+template<typename T>
+static inline T HashRead(const unsigned char* const p)
+{
+	T val;
+	memcpy(&val, p, sizeof(T));
+	return val;
+}
+
+// XXH64 with seed 0, fast enough to not be the bottleneck when hashing maps
+static uint64_t HashBuffer(const void* const pData, const size_t nSize)
+{
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(pData);
+	const unsigned char* const pEnd = p + nSize;
+	uint64_t h;
+
+	if (nSize >= 32)
+	{
+		uint64_t v1 = HASH_PRIME64_1 + HASH_PRIME64_2;
+		uint64_t v2 = HASH_PRIME64_2;
+		uint64_t v3 = 0;
+		uint64_t v4 = 0 - HASH_PRIME64_1;
+
+		for (; p + 32 <= pEnd; p += 32)
+		{
+			v1 = HashRound(v1, HashRead<uint64_t>(p));
+			v2 = HashRound(v2, HashRead<uint64_t>(p + 8));
+			v3 = HashRound(v3, HashRead<uint64_t>(p + 16));
+			v4 = HashRound(v4, HashRead<uint64_t>(p + 24));
+		}
+
+		h = HashRotl64(v1, 1) + HashRotl64(v2, 7) + HashRotl64(v3, 12) + HashRotl64(v4, 18);
+		h = HashMergeRound(h, v1);
+		h = HashMergeRound(h, v2);
+		h = HashMergeRound(h, v3);
+		h = HashMergeRound(h, v4);
+	}
+	else
+		h = HASH_PRIME64_5;
+
+	h += uint64_t(nSize);
+
+	for (; p + 8 <= pEnd; p += 8)
+	{
+		h ^= HashRound(0, HashRead<uint64_t>(p));
+		h = HashRotl64(h, 27) * HASH_PRIME64_1 + HASH_PRIME64_4;
+	}
+
+	if (p + 4 <= pEnd)
+	{
+		h ^= uint64_t(HashRead<uint32_t>(p)) * HASH_PRIME64_1;
+		h = HashRotl64(h, 23) * HASH_PRIME64_2 + HASH_PRIME64_3;
+		p += 4;
+	}
+
+	for (; p < pEnd; p++)
+	{
+		h ^= (*p) * HASH_PRIME64_5;
+		h = HashRotl64(h, 11) * HASH_PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= HASH_PRIME64_2;
+	h ^= h >> 29;
+	h *= HASH_PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: hashes the contents of a file
+// Input  : &filePath -
+//			&hash -
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool CConversionManifest::HashFile(const fs::path& filePath, uint64_t& hash)
+{
+	CMappedFile file;
+	if (!file.Open(filePath))
+		return false;
+
+	hash = HashBuffer(file.GetData(), size_t(file.GetSize()));
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: lists the files that make up a map: the bsp, its lumps and its
+//			entity partitions, with their sizes and times but without hashes
+// Input  : &bspPath -
+//			&inventory - the map's directory listing
+//			&files -
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool CConversionManifest::GetMapFiles(const std::string& bspPath, const CLumpInventory& inventory, std::vector<File_t>& files)
+{
+	const fs::path bspFilePath(bspPath);
+
+	files.clear();
+
+	if (!inventory.IsValid())
+		return false;
+
+	std::error_code ec;
+	const uint64_t bspSize = fs::file_size(bspFilePath, ec);
+
+	if (ec)
+		return false;
+
+	const uint64_t bspTime = uint64_t(fs::last_write_time(bspFilePath, ec).time_since_epoch().count());
+
+	if (ec)
+		return false;
+
+	files.push_back({ bspFilePath.filename().string(), bspSize, bspTime, 0 });
+
+	for (int i = 0; i < LUMP_COUNT; i++)
+	{
+		const CLumpInventory::Entry_t* const pEntry = inventory.FindLump(i);
+
+		if (pEntry)
+			files.push_back({ pEntry->name, pEntry->size, pEntry->mtime, 0 });
+	}
+
+	// the entity partitions can't be matched by name alone, another map's
+	// name may start with this map's name; take them from the partition lump
+	std::vector<std::string> partitionNames;
+	if (GetEntityPartitionNames(bspPath, partitionNames, &inventory))
+	{
+		for (const std::string& partitionName : partitionNames)
+		{
+			const CLumpInventory::Entry_t* const pEntry = inventory.FindEntityPartition(partitionName);
+
+			if (pEntry)
+				files.push_back({ pEntry->name, pEntry->size, pEntry->mtime, 0 });
+		}
+	}
+
+	std::sort(files.begin(), files.end(), [](const File_t& a, const File_t& b) { return a.name < b.name; });
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: finds a file by name, m_files is sorted by name
+//-----------------------------------------------------------------------------
+const CConversionManifest::File_t* CConversionManifest::FindFile(const std::string& name) const
+{
+	const auto it = std::lower_bound(m_files.begin(), m_files.end(), name, [](const File_t& file, const std::string& n) { return file.name < n; });
+
+	return it != m_files.end() && it->name == name ? &*it : nullptr;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: builds the manifest from the map's current files
+// Input  : &bspPath -
+//			&inventory - listing of the map from before it was converted; the
+//			conversion only rewrites files that already exist, so only their
+//			sizes and times are queried again rather than listing the directory
+//			packAllLumps - whether the map has been converted with -pack
+//			*pPrevious - manifest of the map before it was converted, files
+//			the conversion didn't rewrite keep their hash from it; optional
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool CConversionManifest::Build(const std::string& bspPath, CLumpInventory& inventory, const bool packAllLumps, const CConversionManifest* const pPrevious)
+{
+	m_version = CONVERSION_MANIFEST_VERSION;
+	m_packed = packAllLumps;
+
+	if (!inventory.Refresh() || !GetMapFiles(bspPath, inventory, m_files))
+		return false;
+
+	const fs::path directory = fs::path(bspPath).parent_path();
+
+	for (File_t& file : m_files)
+	{
+		const File_t* const pOld = pPrevious ? pPrevious->FindFile(file.name) : nullptr;
+
+		if (pOld && pOld->size == file.size && pOld->mtime == file.mtime)
+		{
+			file.hash = pOld->hash;
+			continue;
+		}
+
+		if (!HashFile(directory / file.name, file.hash))
+			return false;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: loads the manifest stored next to the map
+// Input  : &bspPath -
+// Output : true on success, false if missing or malformed
+//-----------------------------------------------------------------------------
+bool CConversionManifest::Load(const std::string& bspPath)
+{
+	std::ifstream in(GetManifestPath(bspPath));
+	if (!in)
+		return false;
+
+	int packed = 0;
+	std::string tag;
+
+	if (!(in >> tag >> m_version) || tag != "bspconv_manifest" || m_version != CONVERSION_MANIFEST_VERSION)
+		return false;
+	if (!(in >> tag >> packed) || tag != "pack")
+		return false;
+
+	m_packed = packed != 0;
+	m_files.clear();
+
+	File_t file;
+	while (in >> tag >> file.size >> file.mtime >> std::hex >> file.hash >> std::dec && tag == "file")
+	{
+		// the name is the rest of the line, it may contain spaces
+		in.get();
+		if (!std::getline(in, file.name) || file.name.empty())
+			return false;
+
+		m_files.push_back(file);
+	}
+
+	std::sort(m_files.begin(), m_files.end(), [](const File_t& a, const File_t& b) { return a.name < b.name; });
+	return in.eof();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: writes the manifest next to the map
+// Input  : &bspPath -
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool CConversionManifest::Save(const std::string& bspPath) const
+{
+	std::string out = Format("bspconv_manifest %d\npack %d\n", m_version, m_packed ? 1 : 0);
+
+	for (const File_t& file : m_files)
+		out += Format("file %llu %llu %016llx %s\n", (unsigned long long)file.size, (unsigned long long)file.mtime, (unsigned long long)file.hash, file.name.c_str());
+
+	std::ofstream file(GetManifestPath(bspPath), std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	file.write(out.data(), out.size());
+	return file.good();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: checks whether the map's files are still the ones this manifest
+//			was built from; once all names and sizes match, only the files
+//			written since are hashed
+// Input  : &bspPath -
+//			&inventory - the map's directory listing
+//			packAllLumps -
+// Output : true if the map doesn't need to be converted again
+//-----------------------------------------------------------------------------
+bool CConversionManifest::IsUpToDate(const std::string& bspPath, const CLumpInventory& inventory, const bool packAllLumps) const
+{
+	if (m_version != CONVERSION_MANIFEST_VERSION || m_packed != packAllLumps)
+		return false;
+
+	std::vector<File_t> files;
+	if (!GetMapFiles(bspPath, inventory, files) || files.size() != m_files.size())
+		return false;
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		if (files[i].name != m_files[i].name || files[i].size != m_files[i].size)
+			return false;
+	}
+
+	const fs::path directory = fs::path(bspPath).parent_path();
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		if (files[i].mtime == m_files[i].mtime)
+			continue;
+
+		// written since, but maybe with the same data, e.g. copied over again
+
+		uint64_t hash;
+		if (!HashFile(directory / files[i].name, hash) || hash != m_files[i].hash)
+			return false;
+	}
+
+	return true;
+}
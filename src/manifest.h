@@ -0,0 +1,52 @@
+#pragma once
+
+class CLumpInventory;
+
+// bump whenever the conversion output or the manifest format changes, so maps
+// converted by an older build are picked up again by incremental batch runs
+#define CONVERSION_MANIFEST_VERSION 2
+
+//-----------------------------------------------------------------------------
+// Purpose: record of the files a map consisted of after it was converted
+//
+// Stored next to the map as "<map>.bsp.manifest". Batch conversion skips maps
+// whose current files still match their manifest. Files are only hashed when
+// their size matches but their modification time doesn't, so checking an
+// untouched map costs a directory listing. The listing is the map's
+// CLumpInventory, shared with the conversion and with building the manifest.
+//-----------------------------------------------------------------------------
+class CConversionManifest
+{
+public:
+	CConversionManifest() : m_version(0), m_packed(false) {}
+
+	// inventory is the map's listing from before it was converted, its files
+	// are queried again; hashes of files unchanged since pPrevious was built
+	// are taken from it
+	bool Build(const std::string& bspPath, CLumpInventory& inventory, const bool packAllLumps, const CConversionManifest* const pPrevious = nullptr);
+
+	bool Load(const std::string& bspPath);
+	bool Save(const std::string& bspPath) const;
+
+	bool IsUpToDate(const std::string& bspPath, const CLumpInventory& inventory, const bool packAllLumps) const;
+
+	static std::string GetManifestPath(const std::string& bspPath) { return bspPath + ".manifest"; }
+
+private:
+	struct File_t
+	{
+		std::string name; // relative to the map's directory
+		uint64_t size;
+		uint64_t mtime;
+		uint64_t hash;
+	};
+
+	static bool GetMapFiles(const std::string& bspPath, const CLumpInventory& inventory, std::vector<File_t>& files);
+	static bool HashFile(const fs::path& filePath, uint64_t& hash);
+
+	const File_t* FindFile(const std::string& name) const;
+
+	int m_version;
+	bool m_packed;
+	std::vector<File_t> m_files; // sorted by name
+};
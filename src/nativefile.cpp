@@ -0,0 +1,871 @@
+#include "stdafx.h"
+#include "nativefile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#endif
+
+// chunk size used when data has to be copied through user space
+#define FILE_COPY_CHUNK_SIZE (1 << 20)
+
+// size of the buffer directory entries are listed into on Windows
+#define DIRECTORY_LIST_BUFFER_SIZE (64 * 1024)
+
+#ifdef _WIN32
+#define INVALID_NATIVE_HANDLE INVALID_HANDLE_VALUE
+#else
+#define INVALID_NATIVE_HANDLE -1
+#endif
+
+//-----------------------------------------------------------------------------
+// Purpose: CNativeFile constructor/destructor
+//-----------------------------------------------------------------------------
+CNativeFile::CNativeFile()
+{
+	m_hFile = INVALID_NATIVE_HANDLE;
+	m_nFlags = Mode_t::NONE;
+}
+CNativeFile::~CNativeFile()
+{
+	Close();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: opens the file in specified mode
+// Input  : &fsFilePath -
+//			nFlags -
+// Output : true if operation is successful
+//-----------------------------------------------------------------------------
+bool CNativeFile::Open(const fs::path& fsFilePath, int nFlags)
+{
+	Close();
+
+#ifdef _WIN32
+	DWORD access = 0;
+	if (nFlags & Mode_t::READ)
+		access |= GENERIC_READ;
+	if (nFlags & Mode_t::WRITE)
+		access |= GENERIC_WRITE;
+
+	const DWORD disposition = (nFlags & Mode_t::WRITE) ? CREATE_ALWAYS : OPEN_EXISTING;
+	m_hFile = CreateFileW(fsFilePath.c_str(), access, FILE_SHARE_READ, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+	int oflags = O_CLOEXEC;
+	if ((nFlags & Mode_t::READ) && (nFlags & Mode_t::WRITE))
+		oflags |= O_RDWR;
+	else if (nFlags & Mode_t::WRITE)
+		oflags |= O_WRONLY;
+	else
+		oflags |= O_RDONLY;
+
+	if (nFlags & Mode_t::WRITE)
+		oflags |= O_CREAT | O_TRUNC;
+
+	m_hFile = open(fsFilePath.c_str(), oflags, 0644);
+#endif
+
+	if (m_hFile == INVALID_NATIVE_HANDLE)
+		return false;
+
+	m_nFlags = nFlags;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: adopts a handle that has been opened elsewhere, it is closed by
+//			this file from now on
+// Input  : hFile -
+//			nFlags - mode the handle has been opened with
+//-----------------------------------------------------------------------------
+void CNativeFile::Attach(const NativeHandle_t hFile, const int nFlags)
+{
+	Close();
+
+	m_hFile = hFile;
+	m_nFlags = nFlags;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: closes the file
+//-----------------------------------------------------------------------------
+void CNativeFile::Close()
+{
+	if (m_hFile == INVALID_NATIVE_HANDLE)
+		return;
+
+#ifdef _WIN32
+	CloseHandle(m_hFile);
+#else
+	close(m_hFile);
+#endif
+
+	m_hFile = INVALID_NATIVE_HANDLE;
+	m_nFlags = Mode_t::NONE;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: sets the file position
+// Input  : nOffset - absolute offset from the start of the file
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool CNativeFile::Seek(const uint64_t nOffset)
+{
+#ifdef _WIN32
+	LARGE_INTEGER offset;
+	offset.QuadPart = LONGLONG(nOffset);
+
+	return SetFilePointerEx(m_hFile, offset, nullptr, FILE_BEGIN) != FALSE;
+#else
+	return lseek(m_hFile, off_t(nOffset), SEEK_SET) == off_t(nOffset);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: returns the size of the file on disk
+//-----------------------------------------------------------------------------
+uint64_t CNativeFile::GetSize() const
+{
+#ifdef _WIN32
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_hFile, &size))
+		return 0;
+
+	return uint64_t(size.QuadPart);
+#else
+	struct stat st;
+	if (fstat(m_hFile, &st) != 0)
+		return 0;
+
+	return uint64_t(st.st_size);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: reads from the current position
+// Input  : *pDst -
+//			nSize -
+// Output : number of bytes read, less than nSize on EOF or error
+//-----------------------------------------------------------------------------
+size_t CNativeFile::Read(void* const pDst, const size_t nSize)
+{
+	if (!(m_nFlags & Mode_t::READ))
+		return 0;
+
+	char* const pBuf = reinterpret_cast<char*>(pDst);
+	size_t nTotal = 0;
+
+	while (nTotal < nSize)
+	{
+		const size_t nRemaining = nSize - nTotal;
+
+#ifdef _WIN32
+		DWORD nRead = 0;
+		if (!ReadFile(m_hFile, pBuf + nTotal, DWORD(std::min<size_t>(nRemaining, MAXDWORD)), &nRead, nullptr) || !nRead)
+			break;
+#else
+		const ssize_t nRead = read(m_hFile, pBuf + nTotal, nRemaining);
+		if (nRead <= 0)
+			break;
+#endif
+
+		nTotal += size_t(nRead);
+	}
+
+	return nTotal;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: writes at the current position
+// Input  : *pSrc -
+//			nSize -
+// Output : true if everything has been written, false otherwise
+//-----------------------------------------------------------------------------
+bool CNativeFile::Write(const void* const pSrc, const size_t nSize)
+{
+	if (!(m_nFlags & Mode_t::WRITE))
+		return false;
+
+	const char* const pBuf = reinterpret_cast<const char*>(pSrc);
+	size_t nTotal = 0;
+
+	while (nTotal < nSize)
+	{
+		const size_t nRemaining = nSize - nTotal;
+
+#ifdef _WIN32
+		DWORD nWritten = 0;
+		if (!WriteFile(m_hFile, pBuf + nTotal, DWORD(std::min<size_t>(nRemaining, MAXDWORD)), &nWritten, nullptr) || !nWritten)
+			return false;
+#else
+		const ssize_t nWritten = write(m_hFile, pBuf + nTotal, nRemaining);
+		if (nWritten <= 0)
+			return false;
+#endif
+
+		nTotal += size_t(nWritten);
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: reads at the given offset
+// Input  : *pDst -
+//			nSize -
+//			nOffset -
+// Output : number of bytes read, less than nSize on EOF or error
+//-----------------------------------------------------------------------------
+size_t CNativeFile::ReadAt(void* const pDst, const size_t nSize, const uint64_t nOffset)
+{
+	if (!(m_nFlags & Mode_t::READ))
+		return 0;
+
+	char* const pBuf = reinterpret_cast<char*>(pDst);
+	size_t nTotal = 0;
+
+	while (nTotal < nSize)
+	{
+		const size_t nRemaining = nSize - nTotal;
+
+#ifdef _WIN32
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = DWORD(nOffset + nTotal);
+		overlapped.OffsetHigh = DWORD((nOffset + nTotal) >> 32);
+
+		DWORD nRead = 0;
+		if (!ReadFile(m_hFile, pBuf + nTotal, DWORD(std::min<size_t>(nRemaining, MAXDWORD)), &nRead, &overlapped) || !nRead)
+			break;
+#else
+		const ssize_t nRead = pread(m_hFile, pBuf + nTotal, nRemaining, off_t(nOffset + nTotal));
+		if (nRead <= 0)
+			break;
+#endif
+
+		nTotal += size_t(nRead);
+	}
+
+	return nTotal;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: writes at the given offset
+// Input  : *pSrc -
+//			nSize -
+//			nOffset -
+// Output : true if everything has been written, false otherwise
+//-----------------------------------------------------------------------------
+bool CNativeFile::WriteAt(const void* const pSrc, const size_t nSize, const uint64_t nOffset)
+{
+	if (!(m_nFlags & Mode_t::WRITE))
+		return false;
+
+	const char* const pBuf = reinterpret_cast<const char*>(pSrc);
+	size_t nTotal = 0;
+
+	while (nTotal < nSize)
+	{
+		const size_t nRemaining = nSize - nTotal;
+
+#ifdef _WIN32
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = DWORD(nOffset + nTotal);
+		overlapped.OffsetHigh = DWORD((nOffset + nTotal) >> 32);
+
+		DWORD nWritten = 0;
+		if (!WriteFile(m_hFile, pBuf + nTotal, DWORD(std::min<size_t>(nRemaining, MAXDWORD)), &nWritten, &overlapped) || !nWritten)
+			return false;
+#else
+		const ssize_t nWritten = pwrite(m_hFile, pBuf + nTotal, nRemaining, off_t(nOffset + nTotal));
+		if (nWritten <= 0)
+			return false;
+#endif
+
+		nTotal += size_t(nWritten);
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: truncates or extends the file, new space reads back as zeros. the
+//			blocks are reserved up front where the platform supports it, so
+//			concurrent writes into the file don't fragment it
+// Input  : nSize -
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool CNativeFile::SetSize(const uint64_t nSize)
+{
+	if (!(m_nFlags & Mode_t::WRITE))
+		return false;
+
+#ifdef _WIN32
+	FILE_ALLOCATION_INFO allocInfo;
+	allocInfo.AllocationSize.QuadPart = LONGLONG(nSize);
+	SetFileInformationByHandle(m_hFile, FileAllocationInfo, &allocInfo, sizeof(allocInfo)); // just a hint
+
+	FILE_END_OF_FILE_INFO eofInfo;
+	eofInfo.EndOfFile.QuadPart = LONGLONG(nSize);
+
+	return SetFileInformationByHandle(m_hFile, FileEndOfFileInfo, &eofInfo, sizeof(eofInfo)) != FALSE;
+#else
+	if (ftruncate(m_hFile, off_t(nSize)) != 0)
+		return false;
+
+#ifdef __linux__
+	// not supported by every filesystem, the file has the right size anyway
+	if (nSize)
+		posix_fallocate(m_hFile, 0, off_t(nSize));
+#endif
+
+	return true;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: starts asynchronous readahead of the whole file
+// Output : true if the hint has been issued
+//-----------------------------------------------------------------------------
+bool CNativeFile::Prefetch()
+{
+	if (!(m_nFlags & Mode_t::READ))
+		return false;
+
+#ifdef _WIN32
+	const uint64_t nSize = GetSize();
+	if (!nSize)
+		return false;
+
+	// the prefetched pages stay in the standby list after the view is gone
+	const HANDLE hMapping = CreateFileMappingW(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!hMapping)
+		return false;
+
+	void* const pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	bool bIssued = false;
+
+	if (pView)
+	{
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = pView;
+		range.NumberOfBytes = SIZE_T(nSize);
+
+		bIssued = PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0) != FALSE;
+		UnmapViewOfFile(pView);
+	}
+
+	CloseHandle(hMapping);
+	return bIssued;
+#elif defined(POSIX_FADV_WILLNEED)
+	// the readahead carries on after the descriptor is closed
+	return posix_fadvise(m_hFile, 0, 0, POSIX_FADV_WILLNEED) == 0;
+#else
+	return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: copies data between the current positions of two files, advancing
+//			both. the copy is done by the kernel when the platform supports it
+//			and falls back to a bounce buffer otherwise
+// Input  : &outFile -
+//			&inFile -
+//			nSize -
+// Output : true if all nSize bytes have been copied, false otherwise
+//-----------------------------------------------------------------------------
+bool CopyFileRange(CNativeFile& outFile, CNativeFile& inFile, const uint64_t nSize)
+{
+	uint64_t nRemaining = nSize;
+
+#ifdef __linux__
+	// copy_file_range can share extents on reflink capable filesystems and
+	// doesn't work across filesystems on older kernels, sendfile covers that
+	while (nRemaining)
+	{
+		const ssize_t nCopied = copy_file_range(inFile.GetHandle(), nullptr, outFile.GetHandle(), nullptr, size_t(nRemaining), 0);
+		if (nCopied <= 0)
+			break;
+
+		nRemaining -= uint64_t(nCopied);
+	}
+
+	while (nRemaining)
+	{
+		const ssize_t nCopied = sendfile(outFile.GetHandle(), inFile.GetHandle(), nullptr, size_t(nRemaining));
+		if (nCopied <= 0)
+			break;
+
+		nRemaining -= uint64_t(nCopied);
+	}
+#endif
+
+	if (!nRemaining)
+		return true;
+
+	std::unique_ptr<char[]> pBuf(new char[FILE_COPY_CHUNK_SIZE]);
+
+	while (nRemaining)
+	{
+		const size_t nChunkSize = size_t(std::min<uint64_t>(nRemaining, FILE_COPY_CHUNK_SIZE));
+		const size_t nRead = inFile.Read(pBuf.get(), nChunkSize);
+
+		if (!nRead || !outFile.Write(pBuf.get(), nRead))
+			return false;
+
+		nRemaining -= nRead;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: copies data between two files at the given offsets, without using
+//			or moving their file positions; see CopyFileRange
+// Input  : &outFile -
+//			nOutOffset -
+//			&inFile -
+//			nInOffset -
+//			nSize -
+// Output : true if all nSize bytes have been copied, false otherwise
+//-----------------------------------------------------------------------------
+bool CopyFileRangeAt(CNativeFile& outFile, const uint64_t nOutOffset, CNativeFile& inFile, const uint64_t nInOffset, const uint64_t nSize)
+{
+	uint64_t nCopied = 0;
+
+#ifdef __linux__
+	loff_t inOffset = loff_t(nInOffset);
+	loff_t outOffset = loff_t(nOutOffset);
+
+	while (nCopied < nSize)
+	{
+		const ssize_t nResult = copy_file_range(inFile.GetHandle(), &inOffset, outFile.GetHandle(), &outOffset, size_t(nSize - nCopied), 0);
+		if (nResult <= 0)
+			break;
+
+		nCopied += uint64_t(nResult);
+	}
+#endif
+
+	if (nCopied == nSize)
+		return true;
+
+	std::unique_ptr<char[]> pBuf(new char[FILE_COPY_CHUNK_SIZE]);
+
+	while (nCopied < nSize)
+	{
+		const size_t nChunkSize = size_t(std::min<uint64_t>(nSize - nCopied, FILE_COPY_CHUNK_SIZE));
+		const size_t nRead = inFile.ReadAt(pBuf.get(), nChunkSize, nInOffset + nCopied);
+
+		if (!nRead || !outFile.WriteAt(pBuf.get(), nRead, nOutOffset + nCopied))
+			return false;
+
+		nCopied += nRead;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: flushes a file to disk; on POSIX also works for directories, which
+//			makes renames in them durable. directories are skipped on Windows,
+//			where they can't be flushed
+// Input  : &fsPath -
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool SyncPath(const fs::path& fsPath)
+{
+#ifdef _WIN32
+	if (fs::is_directory(fsPath))
+		return true;
+
+	const HANDLE hFile = CreateFileW(fsPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	const bool bSynced = FlushFileBuffers(hFile) != FALSE;
+	CloseHandle(hFile);
+#else
+	const int fd = open(fsPath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	const bool bSynced = fsync(fd) == 0;
+	close(fd);
+#endif
+
+	return bSynced;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: flushes everything written to the file system that contains the
+//			path with a single call, instead of one flush per file
+// Input  : &fsPath - any file or directory on the file system
+// Output : true on success, false if unsupported (only Linux has syncfs)
+//-----------------------------------------------------------------------------
+bool SyncFileSystem(const fs::path& fsPath)
+{
+#ifdef __linux__
+	const int fd = open(fsPath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	const bool bSynced = syncfs(fd) == 0;
+	close(fd);
+
+	return bSynced;
+#else
+	(void)fsPath;
+	return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: identifies the file system that contains the path, paths with the
+//			same id are flushed by the same SyncFileSystem call
+// Input  : &fsPath -
+//			&nId -
+// Output : true on success, false if unsupported or the path can't be queried
+//-----------------------------------------------------------------------------
+bool GetFileSystemId(const fs::path& fsPath, uint64_t& nId)
+{
+#ifdef __linux__
+	struct stat st;
+	if (stat(fsPath.c_str(), &st) != 0)
+		return false;
+
+	nId = uint64_t(st.st_dev);
+	return true;
+#else
+	(void)fsPath;
+	(void)nId;
+	return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CMappedFile constructor/destructor
+//-----------------------------------------------------------------------------
+CMappedFile::CMappedFile()
+{
+	m_pData = nullptr;
+	m_nSize = 0;
+}
+CMappedFile::~CMappedFile()
+{
+	Close();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: maps the whole file; empty files succeed with a null view
+// Input  : &fsFilePath -
+// Output : true if operation is successful
+//-----------------------------------------------------------------------------
+bool CMappedFile::Open(const fs::path& fsFilePath)
+{
+	Close();
+
+	CNativeFile file;
+	return file.Open(fsFilePath, CNativeFile::READ) && Map(file);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: maps the whole file, opened relative to the directory handle
+// Input  : &directory -
+//			&fileName - name of the file, without the directory
+// Output : true if operation is successful
+//-----------------------------------------------------------------------------
+bool CMappedFile::Open(const CNativeDirectory& directory, const std::string& fileName)
+{
+	Close();
+
+	CNativeFile file;
+	return directory.OpenFile(fileName, file, CNativeFile::READ) && Map(file);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: maps an open file copy-on-write, the view stays valid after the
+//			file has been closed
+// Input  : &file - opened for reading
+// Output : true if operation is successful
+//-----------------------------------------------------------------------------
+bool CMappedFile::Map(const CNativeFile& file)
+{
+	const NativeHandle_t hFile = file.GetHandle();
+
+#ifdef _WIN32
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size))
+		return false;
+
+	m_nSize = uint64_t(size.QuadPart);
+
+	if (m_nSize)
+	{
+		// the view keeps the mapping and the file alive after their handles are closed
+		const HANDLE hMapping = CreateFileMappingW(hFile, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		if (hMapping)
+		{
+			m_pData = reinterpret_cast<char*>(MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0));
+			CloseHandle(hMapping);
+		}
+	}
+#else
+	struct stat st;
+	if (fstat(hFile, &st) != 0)
+		return false;
+
+	m_nSize = uint64_t(st.st_size);
+
+	if (m_nSize)
+	{
+		void* const pView = mmap(nullptr, size_t(m_nSize), PROT_READ | PROT_WRITE, MAP_PRIVATE, hFile, 0);
+		if (pView != MAP_FAILED)
+			m_pData = reinterpret_cast<char*>(pView);
+	}
+#endif
+
+	if (m_nSize && !m_pData)
+	{
+		m_nSize = 0;
+		return false;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: unmaps the file
+//-----------------------------------------------------------------------------
+void CMappedFile::Close()
+{
+	if (m_pData)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_pData);
+#else
+		munmap(m_pData, size_t(m_nSize));
+#endif
+	}
+
+	m_pData = nullptr;
+	m_nSize = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CNativeDirectory constructor/destructor
+//-----------------------------------------------------------------------------
+CNativeDirectory::CNativeDirectory()
+{
+	m_hDir = INVALID_NATIVE_HANDLE;
+	m_bOpen = false;
+}
+CNativeDirectory::~CNativeDirectory()
+{
+	Close();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: opens the directory for listing and relative opens
+// Input  : &fsDirPath -
+// Output : true if operation is successful
+//-----------------------------------------------------------------------------
+bool CNativeDirectory::Open(const fs::path& fsDirPath)
+{
+	Close();
+
+#ifdef _WIN32
+	m_hDir = CreateFileW(fsDirPath.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+#else
+	m_hDir = open(fsDirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#endif
+
+	if (m_hDir == INVALID_NATIVE_HANDLE)
+		return false;
+
+	m_path = fsDirPath;
+	m_bOpen = true;
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: closes the directory
+//-----------------------------------------------------------------------------
+void CNativeDirectory::Close()
+{
+	if (m_hDir != INVALID_NATIVE_HANDLE)
+	{
+#ifdef _WIN32
+		CloseHandle(m_hDir);
+#else
+		close(m_hDir);
+#endif
+	}
+
+	m_hDir = INVALID_NATIVE_HANDLE;
+	m_path.clear();
+	m_bOpen = false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: lists the regular files of the directory
+// Input  : &filter - returns true for the file names to list
+//			&entries -
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool CNativeDirectory::List(const std::function<bool(const std::string_view)>& filter, std::vector<Entry_t>& entries) const
+{
+	entries.clear();
+
+	if (!m_bOpen)
+		return false;
+
+#ifdef _WIN32
+	// the listing carries the sizes, so a whole batch of entries is returned
+	// per call without touching the files themselves
+	std::unique_ptr<char[]> buffer(new char[DIRECTORY_LIST_BUFFER_SIZE]);
+	FILE_INFO_BY_HANDLE_CLASS infoClass = FileFullDirectoryRestartInfo;
+
+	while (GetFileInformationByHandleEx(m_hDir, infoClass, buffer.get(), DIRECTORY_LIST_BUFFER_SIZE))
+	{
+		infoClass = FileFullDirectoryInfo;
+
+		for (const char* pCur = buffer.get();;)
+		{
+			const FILE_FULL_DIR_INFO* const pInfo = reinterpret_cast<const FILE_FULL_DIR_INFO*>(pCur);
+
+			if (!(pInfo->FileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			{
+				const std::string name = fs::path(std::wstring(pInfo->FileName, pInfo->FileNameLength / sizeof(WCHAR))).string();
+
+				if (filter(name))
+					entries.push_back({ name, uint64_t(pInfo->EndOfFile.QuadPart), uint64_t(pInfo->LastWriteTime.QuadPart) });
+			}
+
+			if (!pInfo->NextEntryOffset)
+				break;
+
+			pCur += pInfo->NextEntryOffset;
+		}
+	}
+
+	return GetLastError() == ERROR_NO_MORE_FILES;
+#else
+	// the stream gets its own descriptor, m_hDir stays usable for openat
+	const int fd = openat(m_hDir, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	DIR* const pDir = fdopendir(fd);
+	if (!pDir)
+	{
+		close(fd);
+		return false;
+	}
+
+	while (const dirent* const pEntry = readdir(pDir))
+	{
+		const std::string_view name(pEntry->d_name);
+
+		if (!filter(name))
+			continue;
+
+		// relative to the directory, no path walk per file
+		struct stat st;
+		if (fstatat(m_hDir, pEntry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+			continue;
+
+#ifdef __APPLE__
+		const uint64_t mtime = uint64_t(st.st_mtimespec.tv_sec) * 1000000000ull + uint64_t(st.st_mtimespec.tv_nsec);
+#else
+		const uint64_t mtime = uint64_t(st.st_mtim.tv_sec) * 1000000000ull + uint64_t(st.st_mtim.tv_nsec);
+#endif
+
+		entries.push_back({ std::string(name), uint64_t(st.st_size), mtime });
+	}
+
+	closedir(pDir);
+	return true;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: opens a file in the directory
+// Input  : &fileName - name of the file, without the directory
+//			&file -
+//			nFlags - see CNativeFile::Mode_t
+// Output : true if operation is successful
+//-----------------------------------------------------------------------------
+bool CNativeDirectory::OpenFile(const std::string& fileName, CNativeFile& file, const int nFlags) const
+{
+	if (!m_bOpen)
+		return false;
+
+#ifdef _WIN32
+	return file.Open(m_path / fileName, nFlags);
+#else
+	int oflags = O_CLOEXEC;
+	if ((nFlags & CNativeFile::READ) && (nFlags & CNativeFile::WRITE))
+		oflags |= O_RDWR;
+	else if (nFlags & CNativeFile::WRITE)
+		oflags |= O_WRONLY;
+	else
+		oflags |= O_RDONLY;
+
+	if (nFlags & CNativeFile::WRITE)
+		oflags |= O_CREAT | O_TRUNC;
+
+	const int fd = openat(m_hDir, fileName.c_str(), oflags, 0644);
+	if (fd == -1)
+		return false;
+
+	file.Attach(fd, nFlags);
+	return true;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: queries a file in the directory without listing it
+// Input  : &fileName - name of the file, without the directory
+//			&size -
+//			&mtime - in the same units as Entry_t::mtime
+// Output : true if the file exists and is a regular file
+//-----------------------------------------------------------------------------
+bool CNativeDirectory::Stat(const std::string& fileName, uint64_t& size, uint64_t& mtime) const
+{
+	if (!m_bOpen)
+		return false;
+
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExW((m_path / fileName).c_str(), GetFileExInfoStandard, &info) || (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+		return false;
+
+	size = (uint64_t(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+	mtime = (uint64_t(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat st;
+	if (fstatat(m_hDir, fileName.c_str(), &st, 0) != 0 || !S_ISREG(st.st_mode))
+		return false;
+
+	size = uint64_t(st.st_size);
+#ifdef __APPLE__
+	mtime = uint64_t(st.st_mtimespec.tv_sec) * 1000000000ull + uint64_t(st.st_mtimespec.tv_nsec);
+#else
+	mtime = uint64_t(st.st_mtim.tv_sec) * 1000000000ull + uint64_t(st.st_mtim.tv_nsec);
+#endif
+#endif
+
+	return true;
+}
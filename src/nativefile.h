@@ -0,0 +1,134 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+
+#ifdef _WIN32
+typedef void* NativeHandle_t;
+#else
+typedef int NativeHandle_t;
+#endif
+
+class CNativeDirectory;
+
+//-----------------------------------------------------------------------------
+// Purpose: unbuffered file on top of the native OS handle
+//
+// Unlike CIOStream this exposes the underlying handle, so data can be moved
+// between files without passing it through user space (see CopyFileRange).
+//-----------------------------------------------------------------------------
+class CNativeFile
+{
+public:
+	enum Mode_t
+	{
+		NONE = 0,
+		READ = 1 << 0,
+		WRITE = 1 << 1, // creates or truncates the file
+	};
+
+	CNativeFile();
+	~CNativeFile();
+
+	bool Open(const fs::path& fsFilePath, int nFlags);
+	void Attach(const NativeHandle_t hFile, const int nFlags); // takes ownership of an open handle
+	void Close();
+
+	bool Seek(const uint64_t nOffset);
+	uint64_t GetSize() const;
+
+	size_t Read(void* const pDst, const size_t nSize);
+	bool Write(const void* const pSrc, const size_t nSize);
+
+	// positional, these don't use or move the file position and may be called
+	// from multiple threads at once
+	size_t ReadAt(void* const pDst, const size_t nSize, const uint64_t nOffset);
+	bool WriteAt(const void* const pSrc, const size_t nSize, const uint64_t nOffset);
+
+	bool SetSize(const uint64_t nSize);
+
+	// asks the OS to start reading the whole file into the cache in the
+	// background; just a hint, returns false if it couldn't be issued
+	bool Prefetch();
+
+	inline bool IsOpen() const { return m_nFlags != Mode_t::NONE; }
+	inline NativeHandle_t GetHandle() const { return m_hFile; }
+
+private:
+	NativeHandle_t m_hFile;
+	int m_nFlags;
+};
+
+bool CopyFileRange(CNativeFile& outFile, CNativeFile& inFile, const uint64_t nSize);
+bool CopyFileRangeAt(CNativeFile& outFile, const uint64_t nOutOffset, CNativeFile& inFile, const uint64_t nInOffset, const uint64_t nSize);
+
+bool SyncPath(const fs::path& fsPath);
+bool SyncFileSystem(const fs::path& fsPath);
+bool GetFileSystemId(const fs::path& fsPath, uint64_t& nId);
+
+//-----------------------------------------------------------------------------
+// Purpose: read-only file mapped into memory copy-on-write
+//
+// The mapped view is writable, but modifications stay private to the process
+// and never reach the file on disk.
+//-----------------------------------------------------------------------------
+class CMappedFile
+{
+public:
+	CMappedFile();
+	~CMappedFile();
+
+	bool Open(const fs::path& fsFilePath);
+	bool Open(const CNativeDirectory& directory, const std::string& fileName);
+	void Close();
+
+	inline char* GetData() const { return m_pData; }
+	inline uint64_t GetSize() const { return m_nSize; }
+
+private:
+	bool Map(const CNativeFile& file);
+
+	char* m_pData;
+	uint64_t m_nSize;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: directory that is listed and opened from through a single handle
+//
+// Files are opened relative to the directory handle where the OS supports it
+// (openat), so the directory part of their path isn't resolved again for every
+// file. Windows has no public call for that; the file name is appended to the
+// directory path there instead.
+//-----------------------------------------------------------------------------
+class CNativeDirectory
+{
+public:
+	struct Entry_t
+	{
+		std::string name;
+		uint64_t size;
+		uint64_t mtime; // last write, in native units; only good for comparing
+	};
+
+	CNativeDirectory();
+	~CNativeDirectory();
+
+	bool Open(const fs::path& fsDirPath);
+	void Close();
+
+	// lists the regular files in the directory, the size is only queried for
+	// the ones accepted by filter
+	bool List(const std::function<bool(const std::string_view)>& filter, std::vector<Entry_t>& entries) const;
+
+	bool OpenFile(const std::string& fileName, CNativeFile& file, const int nFlags) const;
+	// size and time of a file in the directory, as List reports them
+	bool Stat(const std::string& fileName, uint64_t& size, uint64_t& mtime) const;
+
+	inline bool IsOpen() const { return m_bOpen; }
+	inline NativeHandle_t GetHandle() const { return m_hDir; }
+	inline const fs::path& GetPath() const { return m_path; }
+
+private:
+	NativeHandle_t m_hDir;
+	fs::path m_path;
+	bool m_bOpen;
+};
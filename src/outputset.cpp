@@ -0,0 +1,161 @@
+#include "stdafx.h"
+#include "outputset.h"
+#include "nativefile.h"
+
+#include <map>
+#include <set>
+
+//-----------------------------------------------------------------------------
+// Purpose: records a written output
+// Input  : &filePath - path of the file it replaces
+//-----------------------------------------------------------------------------
+void COutputSet::Add(const std::string& filePath)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_files.push_back(filePath);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: renames every output over the file it replaces
+// Output : true if all of them have been committed
+//-----------------------------------------------------------------------------
+bool COutputSet::Commit()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	bool success = true;
+
+	for (const std::string& filePath : m_files)
+	{
+		const fs::path newFilePath(GetNewPath(filePath));
+
+		// replaces the original in one step, it's never missing in between
+		std::error_code ec;
+		fs::rename(newFilePath, filePath, ec);
+
+		if (ec)
+		{
+			printf("Error replacing file %s: %s\n", newFilePath.filename().string().c_str(), ec.message().c_str());
+			success = false;
+
+			continue;
+		}
+
+		printf("Replaced: %s -> %s\n", newFilePath.filename().string().c_str(), fs::path(filePath).filename().string().c_str());
+	}
+
+	return success;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: removes the outputs of a conversion that didn't finish
+//-----------------------------------------------------------------------------
+void COutputSet::Discard()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (const std::string& filePath : m_files)
+	{
+		std::error_code ec;
+		fs::remove(GetNewPath(filePath), ec);
+	}
+
+	m_files.clear();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: collects the distinct directories the outputs of the sets are in,
+//			grouped by the file system they are on; directories whose file
+//			system can't be told get a group of their own
+//-----------------------------------------------------------------------------
+std::vector<std::vector<fs::path>> COutputSet::GetDirectoriesByFileSystem(const std::vector<const COutputSet*>& sets)
+{
+	std::set<fs::path> directories;
+
+	for (const COutputSet* const pSet : sets)
+	{
+		for (const std::string& filePath : pSet->m_files)
+		{
+			const fs::path directory = fs::path(filePath).parent_path();
+			directories.insert(directory.empty() ? fs::path(".") : directory);
+		}
+	}
+
+	std::vector<std::vector<fs::path>> groups;
+	std::map<uint64_t, size_t> groupOfFileSystem;
+
+	for (const fs::path& directory : directories)
+	{
+		uint64_t fileSystemId;
+
+		if (!GetFileSystemId(directory, fileSystemId))
+		{
+			groups.push_back({ directory });
+			continue;
+		}
+
+		const auto it = groupOfFileSystem.emplace(fileSystemId, groups.size()).first;
+
+		if (it->second == groups.size())
+			groups.emplace_back();
+
+		groups[it->second].push_back(directory);
+	}
+
+	return groups;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: flushes the outputs of the sets to disk, call before Commit
+// Input  : &sets -
+//-----------------------------------------------------------------------------
+void COutputSet::SyncFiles(const std::vector<const COutputSet*>& sets)
+{
+	// a file system flush covers all outputs on it at once, so each file
+	// system is flushed once no matter how many map directories it holds;
+	// only the outputs on file systems that couldn't be flushed are flushed
+	// one by one
+	std::set<fs::path> unsyncedDirectories;
+
+	for (const std::vector<fs::path>& group : GetDirectoriesByFileSystem(sets))
+	{
+		if (!SyncFileSystem(group.front()))
+			unsyncedDirectories.insert(group.begin(), group.end());
+	}
+
+	if (unsyncedDirectories.empty())
+		return;
+
+	for (const COutputSet* const pSet : sets)
+	{
+		for (const std::string& filePath : pSet->m_files)
+		{
+			const fs::path directory = fs::path(filePath).parent_path();
+
+			if (!unsyncedDirectories.count(directory.empty() ? fs::path(".") : directory))
+				continue;
+
+			if (!SyncPath(GetNewPath(filePath)))
+				printf("Failed to flush %s to disk\n", GetNewPath(filePath).c_str());
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: flushes the directories of the outputs to disk, so the renames
+//			done by Commit survive a crash; call after Commit
+// Input  : &sets -
+//-----------------------------------------------------------------------------
+void COutputSet::SyncDirectories(const std::vector<const COutputSet*>& sets)
+{
+	for (const std::vector<fs::path>& group : GetDirectoriesByFileSystem(sets))
+	{
+		if (SyncFileSystem(group.front()))
+			continue;
+
+		for (const fs::path& directory : group)
+		{
+			if (!SyncPath(directory))
+				printf("Failed to flush directory %s to disk\n", directory.string().c_str());
+		}
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <mutex>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Purpose: the files a map conversion has written, committed as a set
+//
+// Outputs are written next to the file they replace as "<file>.new" and
+// recorded here once complete. Commit renames exactly the recorded files over
+// their originals, so unrelated .new files in the same directory (such as the
+// unfinished output of another map) are never picked up.
+//-----------------------------------------------------------------------------
+class COutputSet
+{
+public:
+	static std::string GetNewPath(const std::string& filePath) { return filePath + ".new"; }
+
+	// records that GetNewPath(filePath) has been written, may be called from
+	// multiple threads at once
+	void Add(const std::string& filePath);
+
+	bool Commit(); // renames the outputs over their originals, they stay recorded
+	void Discard(); // removes the outputs and forgets them
+
+	inline bool IsEmpty() const { return m_files.empty(); }
+	inline size_t GetNumFiles() const { return m_files.size(); }
+
+	// group commit: flushes the outputs of all sets before they are committed,
+	// and their directories after; where possible with one flush per file
+	// system instead of one per file
+	static void SyncFiles(const std::vector<const COutputSet*>& sets);
+	static void SyncDirectories(const std::vector<const COutputSet*>& sets);
+
+private:
+	static std::vector<std::vector<fs::path>> GetDirectoriesByFileSystem(const std::vector<const COutputSet*>& sets);
+
+	std::mutex m_mutex;
+	std::vector<std::string> m_files; // final paths, in the order they were added
+};
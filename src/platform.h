@@ -0,0 +1,37 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+// MSVC extensions used throughout the tree, mapped to their standard or POSIX
+// equivalents so it also builds with GCC and Clang
+//-----------------------------------------------------------------------------
+#ifndef _WIN32
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+
+#define __int8 char
+#define __int64 long long
+#define __fastcall
+
+#define _stricmp strcasecmp
+#define sscanf_s sscanf
+
+inline int memcpy_s(void* const pDest, const size_t nDestSize, const void* const pSrc, const size_t nCount)
+{
+	if (nCount > nDestSize)
+		return ERANGE;
+
+	memcpy(pDest, pSrc, nCount);
+	return 0;
+}
+
+inline unsigned char _BitScanReverse(unsigned long* const pIndex, const unsigned long nMask)
+{
+	if (!nMask)
+		return 0;
+
+	*pIndex = (unsigned long)(sizeof(unsigned long) * 8 - 1 - __builtin_clzl(nMask));
+	return 1;
+}
+#endif
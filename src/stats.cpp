@@ -0,0 +1,355 @@
+#include "stdafx.h"
+#include "stats.h"
+#include "arena.h"
+#include "nativefile.h"
+#include "stltools.h"
+
+static const char* const s_lumpNames[LUMP_COUNT] =
+{
+	"entities",
+	"planes",
+	"texdata",
+	"vertexes",
+	"lightprobe_parent_infos",
+	"shadow_environments",
+	"unused_6",
+	"unused_7",
+	"unused_8",
+	"unused_9",
+	"unused_10",
+	"unused_11",
+	"unused_12",
+	"unused_13",
+	"models",
+	"texdata_string_data",
+	"contents_masks",
+	"surface_properties",
+	"bvh_nodes",
+	"bvh_leaf_data",
+	"packed_vertices",
+	"unused_21",
+	"unused_22",
+	"unused_23",
+	"entity_partitions",
+	"unused_25",
+	"unused_26",
+	"unused_27",
+	"unused_28",
+	"unused_29",
+	"vertnormals",
+	"unused_31",
+	"unused_32",
+	"unused_33",
+	"unused_34",
+	"game_lump",
+	"unused_36",
+	"unknown_37",
+	"unknown_38",
+	"unknown_39",
+	"pakfile",
+	"unused_41",
+	"cubemaps",
+	"unknown_43",
+	"unused_44",
+	"unused_45",
+	"unused_46",
+	"unused_47",
+	"unused_48",
+	"unused_49",
+	"unused_50",
+	"unused_51",
+	"unused_52",
+	"unused_53",
+	"world_lights",
+	"world_light_parent_infos",
+	"unused_56",
+	"unused_57",
+	"unused_58",
+	"unused_59",
+	"unused_60",
+	"unused_61",
+	"unused_62",
+	"unused_63",
+	"unused_64",
+	"unused_65",
+	"unused_66",
+	"unused_67",
+	"unused_68",
+	"unused_69",
+	"unused_70",
+	"verts_unlit",
+	"verts_lit_flat",
+	"verts_lit_bump",
+	"verts_unlit_ts",
+	"verts_blinn_phong",
+	"verts_reserved_5",
+	"verts_reserved_6",
+	"verts_reserved_7",
+	"mesh_indices",
+	"meshes",
+	"mesh_bounds",
+	"material_sort",
+	"lightmap_headers",
+	"unused_84",
+	"tweak_lights",
+	"unused_86",
+	"unused_87",
+	"unused_88",
+	"unused_89",
+	"unused_90",
+	"unused_91",
+	"unused_92",
+	"unused_93",
+	"unused_94",
+	"unused_95",
+	"unused_96",
+	"unknown_97",
+	"lightmap_data_sky",
+	"csm_aabb_nodes",
+	"csm_obj_refs",
+	"lightprobes",
+	"static_prop_lightprobe_index",
+	"lightprobetree",
+	"lightproberefs",
+	"lightmap_data_real_time_lights",
+	"cell_bsp_nodes",
+	"cells",
+	"portals",
+	"portal_verts",
+	"portal_edges",
+	"portal_vert_edges",
+	"portal_vert_refs",
+	"portal_edge_refs",
+	"portal_edge_isect_edge",
+	"portal_edge_isect_at_vert",
+	"portal_edge_isect_header",
+	"occlusionmesh_verts",
+	"occlusionmesh_indices",
+	"cell_aabb_nodes",
+	"obj_refs",
+	"obj_ref_bounds",
+	"lightmap_data_rtl_page",
+	"level_info",
+	"shadow_mesh_opaque_verts",
+	"shadow_mesh_alpha_verts",
+	"shadow_mesh_indices",
+	"shadow_mesh_meshes",
+};
+
+void StatsCounters_t::Add(const StatsCounters_t& other)
+{
+	count += other.count;
+	bytesRead += other.bytesRead;
+	bytesWritten += other.bytesWritten;
+	timeNs += other.timeNs;
+	numAllocs += other.numAllocs;
+	allocBytes += other.allocBytes;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CStatsHistogram constructor
+//-----------------------------------------------------------------------------
+CStatsHistogram::CStatsHistogram()
+{
+	memset(m_buckets, 0, sizeof(m_buckets));
+}
+
+void CStatsHistogram::Add(const uint64_t nValue)
+{
+	size_t nBucket = 0;
+
+	for (uint64_t v = nValue; v; v >>= 1)
+		nBucket++;
+
+	m_buckets[nBucket]++;
+}
+
+void CStatsHistogram::Add(const CStatsHistogram& other)
+{
+	for (size_t i = 0; i < V_ARRAYSIZE(m_buckets); i++)
+		m_buckets[i] += other.m_buckets[i];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: appends the histogram as [{"min":x,"max":y,"count":n},...], with the
+//			inclusive range of each non-empty bucket
+// Input  : &json -
+//-----------------------------------------------------------------------------
+void CStatsHistogram::WriteJson(std::string& json) const
+{
+	json += '[';
+	bool first = true;
+
+	for (size_t i = 0; i < V_ARRAYSIZE(m_buckets); i++)
+	{
+		if (!m_buckets[i])
+			continue;
+
+		const unsigned long long nMin = i ? 1ull << (i - 1) : 0;
+		const unsigned long long nMax = i ? nMin * 2 - 1 : 0;
+
+		json += Format("%s{\"min\":%llu,\"max\":%llu,\"count\":%llu}", first ? "" : ",", nMin, nMax, (unsigned long long)m_buckets[i]);
+		first = false;
+	}
+
+	json += ']';
+}
+
+void LumpTypeStats_t::Add(const StatsCounters_t& lump, const uint64_t lumpSize)
+{
+	counters.Add(lump);
+	sizes.Add(lumpSize);
+	times.Add(lump.timeNs / 1000);
+}
+
+void LumpTypeStats_t::Add(const LumpTypeStats_t& other)
+{
+	counters.Add(other.counters);
+	sizes.Add(other.sizes);
+	times.Add(other.times);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CStatsScope constructor/destructor
+//-----------------------------------------------------------------------------
+CStatsScope::CStatsScope(StatsCounters_t& counters) : m_counters(counters)
+{
+	const ArenaAllocStats_t allocs = CArena::GetThreadAllocStats();
+
+	m_nStartNs = CScopeTimer::GetTime();
+	m_nStartAllocs = allocs.numAllocs;
+	m_nStartAllocBytes = allocs.numBytes;
+}
+CStatsScope::~CStatsScope()
+{
+	const ArenaAllocStats_t allocs = CArena::GetThreadAllocStats();
+	const int64_t nEndNs = CScopeTimer::GetTime();
+
+	m_counters.timeNs += uint64_t(nEndNs - m_nStartNs);
+	m_counters.numAllocs += allocs.numAllocs - m_nStartAllocs;
+	m_counters.allocBytes += allocs.numBytes - m_nStartAllocBytes;
+}
+
+const char* GetLumpName(const int lumpIdx)
+{
+	return lumpIdx >= 0 && lumpIdx < LUMP_COUNT ? s_lumpNames[lumpIdx] : "unknown";
+}
+
+static void WriteCounters(std::string& json, const StatsCounters_t& counters)
+{
+	json += Format("\"count\":%llu,\"bytesRead\":%llu,\"bytesWritten\":%llu,\"timeMs\":%.3f,\"allocs\":%llu,\"allocBytes\":%llu",
+		(unsigned long long)counters.count, (unsigned long long)counters.bytesRead, (unsigned long long)counters.bytesWritten,
+		counters.timeNs / 1e6, (unsigned long long)counters.numAllocs, (unsigned long long)counters.allocBytes);
+}
+
+static void WriteLumpTypeStats(std::string& json, const LumpTypeStats_t& stats)
+{
+	json += '{';
+	WriteCounters(json, stats.counters);
+	json += ",\"sizeHistogram\":";
+	stats.sizes.WriteJson(json);
+	json += ",\"timeHistogramUs\":";
+	stats.times.WriteJson(json);
+	json += '}';
+}
+
+// writes the lump types that have been seen, and the entity partitions
+static void WriteLumps(std::string& json, const LumpTypeStats_t* const lumps, const LumpTypeStats_t& entityPartitions, const char* const pszIndent)
+{
+	json += Format("%s\"lumps\":{", pszIndent);
+	bool first = true;
+
+	for (int i = 0; i < LUMP_COUNT; i++)
+	{
+		if (!lumps[i].counters.count)
+			continue;
+
+		json += Format("%s\n%s  \"%s\":", first ? "" : ",", pszIndent, GetLumpName(i));
+		WriteLumpTypeStats(json, lumps[i]);
+		first = false;
+	}
+
+	json += Format("\n%s},\n%s\"entityPartitions\":", pszIndent, pszIndent);
+	WriteLumpTypeStats(json, entityPartitions);
+}
+
+static StatsCounters_t GetTotals(const LumpTypeStats_t* const lumps, const LumpTypeStats_t& entityPartitions)
+{
+	StatsCounters_t totals;
+
+	for (int i = 0; i < LUMP_COUNT; i++)
+		totals.Add(lumps[i].counters);
+
+	totals.Add(entityPartitions.counters);
+	return totals;
+}
+
+// MB/s of the given bytes over the given time
+static double GetThroughput(const uint64_t numBytes, const uint64_t timeNs)
+{
+	return timeNs ? (numBytes / 1e6) / (timeNs / 1e9) : 0.0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: writes the stats report
+// Input  : &filePath -
+//			&maps - every map that has been converted or failed to
+//			wallTimeNs -
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool WriteStatsReport(const std::string& filePath, const std::vector<const MapStats_t*>& maps, const uint64_t wallTimeNs)
+{
+	std::string json = "{\n  \"maps\": [";
+
+	// too large for the stack
+	std::vector<LumpTypeStats_t> lumps(LUMP_COUNT);
+	LumpTypeStats_t entityPartitions;
+	CStatsHistogram mapTimes;
+	size_t numConverted = 0;
+
+	for (size_t m = 0; m < maps.size(); m++)
+	{
+		const MapStats_t& map = *maps[m];
+		const StatsCounters_t totals = GetTotals(map.lumps, map.entityPartitions);
+
+		json += m ? ",\n    {\n      \"path\":" : "\n    {\n      \"path\":";
+		AppendJsonString(json, map.path);
+		json += Format(",\n      \"bspVersion\":%i,\n      \"converted\":%s,\n      \"timeMs\":%.3f,\n      \"readMBps\":%.3f,\n      \"writeMBps\":%.3f,\n      \"totals\":{",
+			map.version, map.converted ? "true" : "false", map.timeNs / 1e6,
+			GetThroughput(totals.bytesRead, map.timeNs), GetThroughput(totals.bytesWritten, map.timeNs));
+		WriteCounters(json, totals);
+		json += "},\n";
+		WriteLumps(json, map.lumps, map.entityPartitions, "      ");
+		json += "\n    }";
+
+		for (int i = 0; i < LUMP_COUNT; i++)
+			lumps[i].Add(map.lumps[i]);
+
+		entityPartitions.Add(map.entityPartitions);
+		mapTimes.Add(map.timeNs / 1000);
+
+		if (map.converted)
+			numConverted++;
+	}
+
+	const StatsCounters_t totals = GetTotals(lumps.data(), entityPartitions);
+
+	json += Format("\n  ],\n  \"aggregate\": {\n    \"numMaps\":%zu,\n    \"numConverted\":%zu,\n    \"wallTimeMs\":%.3f,\n    \"readMBps\":%.3f,\n    \"writeMBps\":%.3f,\n    \"totals\":{",
+		maps.size(), numConverted, wallTimeNs / 1e6, GetThroughput(totals.bytesRead, wallTimeNs), GetThroughput(totals.bytesWritten, wallTimeNs));
+	WriteCounters(json, totals);
+	json += "},\n    \"mapTimeHistogramUs\":";
+	mapTimes.WriteJson(json);
+	json += ",\n";
+	WriteLumps(json, lumps.data(), entityPartitions, "    ");
+	json += "\n  }\n}\n";
+
+	CNativeFile out;
+	if (!out.Open(filePath, CNativeFile::WRITE) || !out.Write(json.data(), json.size()))
+	{
+		printf("Failed to write stats file \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	printf("Wrote stats to \"%s\"\n", filePath.c_str());
+	return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "bspfile.h"
+
+// counters of one kind of work, e.g. all lumps of a type
+struct StatsCounters_t
+{
+	StatsCounters_t() : count(0), bytesRead(0), bytesWritten(0), timeNs(0), numAllocs(0), allocBytes(0) {}
+
+	void Add(const StatsCounters_t& other);
+
+	uint64_t count;
+	uint64_t bytesRead;
+	uint64_t bytesWritten;
+	uint64_t timeNs; // summed over all threads that worked on it
+	uint64_t numAllocs; // lump memory taken from the map's arena
+	uint64_t allocBytes;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: counts values in power of two buckets; bucket 0 holds zeros and
+//			bucket n the values in [2^(n-1), 2^n)
+//-----------------------------------------------------------------------------
+class CStatsHistogram
+{
+public:
+	CStatsHistogram();
+
+	void Add(const uint64_t nValue);
+	void Add(const CStatsHistogram& other);
+
+	// appends the non-empty buckets as a JSON array
+	void WriteJson(std::string& json) const;
+
+private:
+	uint64_t m_buckets[65];
+};
+
+struct LumpTypeStats_t
+{
+	void Add(const StatsCounters_t& lump, const uint64_t lumpSize);
+	void Add(const LumpTypeStats_t& other);
+
+	StatsCounters_t counters;
+	CStatsHistogram sizes; // bytes per lump
+	CStatsHistogram times; // microseconds per lump
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: what the conversion of a map did, ConvertBSP fills in everything
+//			but path, converted and timeNs
+//-----------------------------------------------------------------------------
+struct MapStats_t
+{
+	MapStats_t() : version(0), converted(false), timeNs(0) {}
+
+	std::string path;
+	int version; // before conversion
+	bool converted;
+	uint64_t timeNs; // wall time of the whole map
+
+	LumpTypeStats_t lumps[LUMP_COUNT];
+	LumpTypeStats_t entityPartitions;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: adds the time and the arena allocations of the calling thread from
+//			its construction to its destruction to counters
+//-----------------------------------------------------------------------------
+class CStatsScope
+{
+public:
+	CStatsScope(StatsCounters_t& counters);
+	~CStatsScope();
+
+private:
+	StatsCounters_t& m_counters;
+	int64_t m_nStartNs;
+	uint64_t m_nStartAllocs;
+	uint64_t m_nStartAllocBytes;
+};
+
+const char* GetLumpName(const int lumpIdx);
+
+// writes the stats of the maps and their aggregate as JSON, wallTimeNs is the
+// time all of them took together
+bool WriteStatsReport(const std::string& filePath, const std::vector<const MapStats_t*>& maps, const uint64_t wallTimeNs);
@@ -1,12 +1,18 @@
 #pragma once
+#include "platform.h"
 
+#include <cstring>
+#include <string>
+#include <vector>
 #include <iostream>
 #include <memory>
+#include <exception>
 #include <cassert>
 #include <algorithm>
 #include <map>
 #include <unordered_map>
 #include <fstream>
+#include <string_view>
 
 #include "utils.h"
 
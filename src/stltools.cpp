@@ -1,9 +1,14 @@
 #include "stdafx.h"
 #include "stltools.h"
+#include "cpufeatures.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 // For formatting a STL string using C-style format specifiers (va_list version).
-std::string FormatV(const char* const szFormat, const va_list args)
+std::string FormatV(const char* const szFormat, va_list args)
 {
     // Initialize use of the variable argument array.
     va_list argsCopy;
@@ -78,65 +83,257 @@ std::string RemoveExtension(const std::string& svInput)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// For encoding data in Base64.
-std::string Base64Encode(const char* const buffer, const size_t size)
+// For appending a string to JSON output as a quoted and escaped JSON string.
+void AppendJsonString(std::string& svOutput, const std::string_view svInput)
 {
-    std::string result;
-    int val = 0, valb = -6;
+    svOutput += '"';
 
-    size_t i = 0;
+    for (const char c : svInput)
+    {
+        if (c == '"' || c == '\\')
+        {
+            svOutput += '\\';
+            svOutput += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+            svOutput += Format("\\u%04x", c);
+        else
+            svOutput += c;
+    }
+
+    svOutput += '"';
+}
 
-    while (i < size)
+///////////////////////////////////////////////////////////////////////////////
+// Base64 lookup tables.
+static const char s_base64EncodeTable[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+struct Base64DecodeTable_t
+{
+    constexpr Base64DecodeTable_t() : values()
     {
-        unsigned char c = buffer[i];
-        i++;
+        for (int i = 0; i < 256; i++)
+        {
+            values[i] = 0xFF; // Not part of the alphabet.
+        }
+        for (int i = 0; i < 64; i++)
+        {
+            values[static_cast<unsigned char>("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[i])] = static_cast<unsigned char>(i);
+        }
+    }
+
+    unsigned char values[256];
+};
+static constexpr Base64DecodeTable_t s_base64DecodeTable;
+
+#ifdef CPU_X86
+///////////////////////////////////////////////////////////////////////////////
+// Encodes 12 bytes into 16 characters, reads 16 bytes from pIn.
+TARGET_SSSE3 static __m128i Base64Encode_SSSE3(const unsigned char* const pIn)
+{
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn));
+
+    // Spread each 3 byte group over 4 lanes and extract the 6 bit indices.
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    const __m128i indices = _mm_or_si128(t1, t3);
+
+    // Map the indices to the alphabet by adding a per range offset.
+    __m128i offsetIdx = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i isUpper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    offsetIdx = _mm_or_si128(offsetIdx, _mm_and_si128(isUpper, _mm_set1_epi8(13)));
+
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+    return _mm_add_epi8(_mm_shuffle_epi8(offsets, offsetIdx), indices);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Decodes 16 characters into 12 bytes (written as 16), returns false without
+// writing if any of the characters isn't part of the alphabet.
+TARGET_SSSE3 static bool Base64Decode_SSSE3(const char* const pIn, unsigned char* const pOut)
+{
+    const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn));
+
+    // Classify each character by its nibbles; the AND of both lookups is only
+    // zero for characters in the alphabet.
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2F);
+
+    const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask2F);
+    const __m128i loNibbles = _mm_and_si128(in, mask2F);
+    const __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+    const __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+    {
+        return false;
+    }
+
+    // Translate to 6 bit values; '/' shares its high nibble with '+'.
+    const __m128i isSlash = _mm_cmpeq_epi8(in, mask2F);
+    const __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(isSlash, hiNibbles));
+    const __m128i values = _mm_add_epi8(in, roll);
+
+    // Pack 4x6 bits into 3 bytes per group.
+    const __m128i mergedPairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const __m128i merged = _mm_madd_epi16(mergedPairs, _mm_set1_epi32(0x00011000));
+    const __m128i out = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut), out);
+    return true;
+}
+#endif // CPU_X86
+
+///////////////////////////////////////////////////////////////////////////////
+// For encoding data in Base64, pOutput must be able to hold
+// Base64EncodedSize(size) bytes.
+void Base64Encode(const char* const buffer, const size_t size, char* const pOutput)
+{
+    const unsigned char* const pIn = reinterpret_cast<const unsigned char*>(buffer);
+
+    char* pOut = pOutput;
+    size_t i = 0;
 
-        val = (val << 8) + c;
-        valb += 8;
-        while (valb >= 0)
+#ifdef CPU_X86
+    if (CPU_HasSSSE3())
+    {
+        // Each block reads 16 bytes but only consumes 12.
+        for (; i + 16 <= size; i += 12, pOut += 16)
         {
-            result.push_back("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[(val >> valb) & 0x3F]);
-            valb -= 6;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut), Base64Encode_SSSE3(pIn + i));
         }
     }
-    if (valb > -6)
+#endif
+
+    for (; i + 3 <= size; i += 3, pOut += 4)
     {
-        result.push_back("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[((val << 8) >> (valb + 8)) & 0x3F]);
+        const uint32_t val = (uint32_t(pIn[i]) << 16) | (uint32_t(pIn[i + 1]) << 8) | pIn[i + 2];
+
+        pOut[0] = s_base64EncodeTable[(val >> 18) & 0x3F];
+        pOut[1] = s_base64EncodeTable[(val >> 12) & 0x3F];
+        pOut[2] = s_base64EncodeTable[(val >> 6) & 0x3F];
+        pOut[3] = s_base64EncodeTable[val & 0x3F];
     }
-    while (result.size() % 4)
+
+    const size_t remainder = size - i;
+
+    if (remainder)
     {
-        result.push_back('=');
+        const uint32_t val = (uint32_t(pIn[i]) << 16) | (remainder > 1 ? uint32_t(pIn[i + 1]) << 8 : 0);
+
+        pOut[0] = s_base64EncodeTable[(val >> 18) & 0x3F];
+        pOut[1] = s_base64EncodeTable[(val >> 12) & 0x3F];
+        pOut[2] = remainder > 1 ? s_base64EncodeTable[(val >> 6) & 0x3F] : '=';
+        pOut[3] = '=';
     }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// For encoding data in Base64, replaces the contents of svOutput.
+void Base64Encode(const char* const buffer, const size_t size, std::string& svOutput)
+{
+    svOutput.resize(Base64EncodedSize(size));
+
+    if (size)
+        Base64Encode(buffer, size, &svOutput[0]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// For encoding data in Base64.
+std::string Base64Encode(const char* const buffer, const size_t size)
+{
+    std::string result;
+    Base64Encode(buffer, size, result);
+
     return result;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// For decoding data in Base64.
-std::vector<unsigned char> Base64Decode(const std::string& svInput)
+// For decoding data in Base64, decoding stops at the first character that
+// isn't part of the alphabet (including padding). pOutput must be able to hold
+// Base64DecodedSizeMax(nInputLen) bytes; returns the number of bytes written.
+size_t Base64Decode(const char* const pInput, const size_t nInputLen, unsigned char* const pOutput)
 {
-    std::vector<unsigned char> result;
-    int val = 0, valb = -8;
+    const unsigned char* const pIn = reinterpret_cast<const unsigned char*>(pInput);
+    const unsigned char* const T = s_base64DecodeTable.values;
+
+    unsigned char* pOut = pOutput;
+    size_t i = 0;
+
+#ifdef CPU_X86
+    if (CPU_HasSSSE3())
+    {
+        // Each block stores 16 bytes but only produces 12, keep enough input
+        // left so the extra 4 stay within the output buffer.
+        for (; i + 24 <= nInputLen; i += 16, pOut += 12)
+        {
+            if (!Base64Decode_SSSE3(pInput + i, pOut))
+            {
+                break;
+            }
+        }
+    }
+#endif
 
-    std::vector<int> T(256, -1);
-    for (int i = 0; i < 64; i++)
+    // Full quads.
+    for (; i + 4 <= nInputLen; i += 4, pOut += 3)
     {
-        T["ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[i]] = i;
+        const uint32_t a = T[pIn[i]], b = T[pIn[i + 1]], c = T[pIn[i + 2]], d = T[pIn[i + 3]];
+
+        if ((a | b | c | d) & 0x80)
+        {
+            break;
+        }
+
+        const uint32_t val = (a << 18) | (b << 12) | (c << 6) | d;
+
+        pOut[0] = static_cast<unsigned char>(val >> 16);
+        pOut[1] = static_cast<unsigned char>(val >> 8);
+        pOut[2] = static_cast<unsigned char>(val);
     }
 
-    for (unsigned char c : svInput)
+    // Trailing characters up to the end or the first invalid one; incomplete
+    // bytes are dropped.
+    uint32_t val = 0;
+    int valb = -8;
+
+    for (; i < nInputLen; i++)
     {
-        if (T[c] == -1)
+        const uint32_t c = T[pIn[i]];
+
+        if (c & 0x80)
         {
             break;
         }
-        val = (val << 6) + T[c];
+
+        val = (val << 6) | c;
         valb += 6;
+
         if (valb >= 0)
         {
-            result.push_back(char((val >> valb) & 0xFF));
+            *pOut++ = static_cast<unsigned char>((val >> valb) & 0xFF);
             valb -= 8;
         }
     }
+
+    return size_t(pOut - pOutput);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// For decoding data in Base64.
+std::vector<unsigned char> Base64Decode(const std::string_view svInput)
+{
+    std::vector<unsigned char> result(Base64DecodedSizeMax(svInput.size()));
+    result.resize(Base64Decode(svInput.data(), svInput.size(), result.data()));
+
     return result;
 }
 
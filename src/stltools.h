@@ -1,12 +1,19 @@
 #pragma once
 
 // string:
-std::string FormatV(const char* const szFormat, const va_list args);
+std::string FormatV(const char* const szFormat, va_list args);
 std::string Format(const char* const szFormat, ...);
 std::string GetExtension(const std::string& svInput, const bool bReturnOriginal, const bool bKeepDelimiter);
 std::string RemoveExtension(const std::string& svInput);
+void AppendJsonString(std::string& svOutput, const std::string_view svInput);
 //std::string Base64Encode(const std::string& svInput);
 std::string Base64Encode(const char* const buffer, const size_t size);
+void Base64Encode(const char* const buffer, const size_t size, std::string& svOutput);
+void Base64Encode(const char* const buffer, const size_t size, char* const pOutput);
 //std::string Base64Decode(const std::string& svInput);
-std::vector<unsigned char> Base64Decode(const std::string& svInput);
+std::vector<unsigned char> Base64Decode(const std::string_view svInput);
+size_t Base64Decode(const char* const pInput, const size_t nInputLen, unsigned char* const pOutput);
+
+inline size_t Base64EncodedSize(const size_t nInputLen) { return ((nInputLen + 2) / 3) * 4; }
+inline size_t Base64DecodedSizeMax(const size_t nInputLen) { return (nInputLen / 4) * 3 + ((nInputLen % 4) * 3) / 4; }
 std::vector<std::string> StringSplit(std::string svInput, const char cDelim, const size_t nMax = SIZE_MAX);
@@ -0,0 +1,226 @@
+#include "stdafx.h"
+#include "threadpool.h"
+
+// the pool and queue index of the calling thread, used to route submissions
+// from a worker to its own queue and to pick the queue a waiter pops from
+static thread_local const CThreadPool* s_pCurrentPool = nullptr;
+static thread_local size_t s_currentQueueIdx = 0;
+
+//-----------------------------------------------------------------------------
+// Purpose: CTaskGroup bookkeeping
+//-----------------------------------------------------------------------------
+void CTaskGroup::Add()
+{
+	m_numPending.fetch_add(1, std::memory_order_relaxed);
+}
+void CTaskGroup::Done()
+{
+	// decremented under the lock, so once a waiter has taken the lock after
+	// seeing the group done it is safe to destroy the group
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_numPending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		m_doneCond.notify_all();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CThreadPool constructor
+// Input  : numThreads - number of worker threads, may be 0
+//-----------------------------------------------------------------------------
+CThreadPool::CThreadPool(const size_t numThreads)
+{
+	m_numQueued = 0;
+	m_shutdown = false;
+
+	for (size_t i = 0; i < numThreads + 1; i++)
+		m_queues.emplace_back(new JobQueue_t);
+
+	for (size_t i = 0; i < numThreads; i++)
+		m_threads.emplace_back(&CThreadPool::WorkerThread, this, i);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CThreadPool destructor, finishes all queued tasks
+//-----------------------------------------------------------------------------
+CThreadPool::~CThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_shutdown = true;
+	}
+	m_wakeCond.notify_all();
+
+	for (std::thread& thread : m_threads)
+		thread.join();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: queues a task; the group is signaled once it has finished
+// Input  : &group -
+//			&&task -
+//-----------------------------------------------------------------------------
+void CThreadPool::Submit(CTaskGroup& group, Task_t&& task)
+{
+	group.Add();
+
+	// workers push to their own queue, everyone else shares the last one
+	const size_t queueIdx = (s_pCurrentPool == this) ? s_currentQueueIdx : m_threads.size();
+	JobQueue_t& queue = *m_queues[queueIdx];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back({ std::move(task), &group });
+	}
+
+	m_numQueued.fetch_add(1, std::memory_order_release);
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+	}
+	m_wakeCond.notify_one();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: blocks until all tasks in the group have finished, executing
+//			pending tasks of the group on the calling thread in the meantime.
+//			tasks of other groups are left alone, so a task waiting on its
+//			subtasks never ends up running an unrelated (possibly long) task
+// Input  : &group -
+//-----------------------------------------------------------------------------
+void CThreadPool::Wait(CTaskGroup& group)
+{
+	while (!group.IsDone())
+	{
+		if (RunPendingJob(&group))
+			continue;
+
+		// nothing left to help with, the remaining tasks are running elsewhere
+		std::unique_lock<std::mutex> lock(group.m_mutex);
+		group.m_doneCond.wait_for(lock, std::chrono::milliseconds(1), [&group] { return group.IsDone(); });
+	}
+
+	// the task that finished the group may still be inside Done
+	std::lock_guard<std::mutex> lock(group.m_mutex);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: removes the job at it from the queue, the queue must be locked
+//-----------------------------------------------------------------------------
+void CThreadPool::TakeJob(JobQueue_t& queue, const std::deque<Job_t>::iterator it, Job_t& job)
+{
+	job = std::move(*it);
+	queue.jobs.erase(it);
+
+	m_numQueued.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: pops the most recently queued job from a worker queue (LIFO), the
+//			shared external queue is consumed in submission order (FIFO)
+// Input  : queueIdx -
+//			*pGroup - only consider jobs of this group, any job if nullptr
+//			&job -
+//-----------------------------------------------------------------------------
+bool CThreadPool::PopJob(const size_t queueIdx, const CTaskGroup* const pGroup, Job_t& job)
+{
+	JobQueue_t& queue = *m_queues[queueIdx];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	const auto isWanted = [pGroup](const Job_t& candidate) { return !pGroup || candidate.group == pGroup; };
+
+	if (queueIdx == m_threads.size())
+	{
+		const auto it = std::find_if(queue.jobs.begin(), queue.jobs.end(), isWanted);
+		if (it == queue.jobs.end())
+			return false;
+
+		TakeJob(queue, it, job);
+	}
+	else
+	{
+		const auto it = std::find_if(queue.jobs.rbegin(), queue.jobs.rend(), isWanted);
+		if (it == queue.jobs.rend())
+			return false;
+
+		TakeJob(queue, std::prev(it.base()), job);
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: steals the oldest job from any other queue (FIFO)
+// Input  : thiefIdx -
+//			*pGroup - only consider jobs of this group, any job if nullptr
+//			&job -
+//-----------------------------------------------------------------------------
+bool CThreadPool::StealJob(const size_t thiefIdx, const CTaskGroup* const pGroup, Job_t& job)
+{
+	const size_t numQueues = m_queues.size();
+	const auto isWanted = [pGroup](const Job_t& candidate) { return !pGroup || candidate.group == pGroup; };
+
+	for (size_t i = 1; i < numQueues; i++)
+	{
+		JobQueue_t& queue = *m_queues[(thiefIdx + i) % numQueues];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		const auto it = std::find_if(queue.jobs.begin(), queue.jobs.end(), isWanted);
+		if (it == queue.jobs.end())
+			continue;
+
+		TakeJob(queue, it, job);
+		return true;
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: runs one pending job on the calling thread
+// Input  : *pGroup - only run jobs of this group, any job if nullptr
+// Output : true if a job was executed, false if there was nothing to run
+//-----------------------------------------------------------------------------
+bool CThreadPool::RunPendingJob(const CTaskGroup* const pGroup)
+{
+	if (m_numQueued.load(std::memory_order_acquire) == 0)
+		return false;
+
+	const size_t queueIdx = (s_pCurrentPool == this) ? s_currentQueueIdx : m_threads.size();
+	Job_t job;
+
+	if (!PopJob(queueIdx, pGroup, job) && !StealJob(queueIdx, pGroup, job))
+		return false;
+
+	try
+	{
+		job.task();
+	}
+	catch (...)
+	{
+		// tasks are expected to handle their own errors
+		assert(0);
+	}
+
+	job.group->Done();
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: worker thread main loop
+// Input  : workerIdx -
+//-----------------------------------------------------------------------------
+void CThreadPool::WorkerThread(const size_t workerIdx)
+{
+	s_pCurrentPool = this;
+	s_currentQueueIdx = workerIdx;
+
+	for (;;)
+	{
+		if (RunPendingJob(nullptr))
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_wakeMutex);
+		m_wakeCond.wait(lock, [this] { return m_shutdown || m_numQueued.load(std::memory_order_acquire) > 0; });
+
+		if (m_shutdown && m_numQueued.load(std::memory_order_acquire) == 0)
+			break;
+	}
+}
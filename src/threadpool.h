@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Purpose: tracks completion of a set of tasks submitted to a CThreadPool
+//-----------------------------------------------------------------------------
+class CTaskGroup
+{
+	friend class CThreadPool;
+
+public:
+	CTaskGroup() : m_numPending(0) {}
+
+	inline bool IsDone() const { return m_numPending.load(std::memory_order_acquire) == 0; }
+
+private:
+	void Add();
+	void Done();
+
+	std::atomic<size_t> m_numPending;
+	std::mutex m_mutex;
+	std::condition_variable m_doneCond;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: work-stealing thread pool
+//
+// Each worker owns a task deque. Tasks submitted from a worker go to the back
+// of its own deque and are popped LIFO, idle workers steal from the front of
+// the other deques. Threads waiting on a CTaskGroup execute pending tasks of
+// that group while they wait, so tasks may submit and wait on nested tasks
+// without deadlocking and a pool created with 0 threads runs everything on the
+// waiting thread.
+//-----------------------------------------------------------------------------
+class CThreadPool
+{
+public:
+	typedef std::function<void()> Task_t;
+
+	CThreadPool(const size_t numThreads);
+	~CThreadPool();
+
+	void Submit(CTaskGroup& group, Task_t&& task);
+	void Wait(CTaskGroup& group);
+
+	inline size_t GetNumThreads() const { return m_threads.size(); }
+
+private:
+	struct Job_t
+	{
+		Task_t task;
+		CTaskGroup* group;
+	};
+
+	struct JobQueue_t
+	{
+		std::mutex mutex;
+		std::deque<Job_t> jobs;
+	};
+
+	void TakeJob(JobQueue_t& queue, const std::deque<Job_t>::iterator it, Job_t& job);
+	bool PopJob(const size_t queueIdx, const CTaskGroup* const pGroup, Job_t& job);
+	bool StealJob(const size_t thiefIdx, const CTaskGroup* const pGroup, Job_t& job);
+	bool RunPendingJob(const CTaskGroup* const pGroup);
+
+	void WorkerThread(const size_t workerIdx);
+
+	std::vector<std::unique_ptr<JobQueue_t>> m_queues; // one per worker, plus one shared by external threads
+	std::vector<std::thread> m_threads;
+
+	std::atomic<size_t> m_numQueued;
+
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wakeCond;
+	bool m_shutdown;
+};
+
+// pool the converter runs its background work on (entity partitions), set up
+// by main for the duration of the conversion; work runs inline when nullptr
+inline CThreadPool* g_pThreadPool = nullptr;
@@ -0,0 +1,141 @@
+#include "stdafx.h"
+#include "trace.h"
+#include "nativefile.h"
+#include "stltools.h"
+
+#include <mutex>
+#include <vector>
+
+struct TraceSpan_t
+{
+	const char* pszName;
+	std::string detail;
+	int64_t nStartNs;
+	int64_t nEndNs;
+};
+
+struct TraceThread_t
+{
+	size_t id; // in order of the first span recorded
+	std::mutex mutex; // only contended while the trace is written
+	std::vector<TraceSpan_t> spans;
+};
+
+// thread buffers outlive their threads, the pool's workers are gone by the
+// time the trace is written
+static std::mutex s_threadsMutex;
+static std::vector<std::unique_ptr<TraceThread_t>> s_threads;
+static thread_local TraceThread_t* s_pThread = nullptr;
+
+static int64_t s_nTraceStartNs = 0;
+
+static TraceThread_t& GetTraceThread()
+{
+	if (!s_pThread)
+	{
+		std::lock_guard<std::mutex> lock(s_threadsMutex);
+
+		s_threads.emplace_back(new TraceThread_t);
+		s_pThread = s_threads.back().get();
+		s_pThread->id = s_threads.size() - 1;
+	}
+
+	return *s_pThread;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: records a finished span of the calling thread, see CScopeTimer
+// Input  : *pszName -
+//			*pDetail - optional, e.g. the file the span worked on
+//			nStartNs -
+//			nEndNs -
+//-----------------------------------------------------------------------------
+void TraceRecordSpan(const char* const pszName, const std::string* const pDetail, const int64_t nStartNs, const int64_t nEndNs)
+{
+	TraceThread_t& thread = GetTraceThread();
+	std::lock_guard<std::mutex> lock(thread.mutex);
+
+	thread.spans.push_back({ pszName, pDetail ? *pDetail : std::string(), nStartNs, nEndNs });
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: starts recording, the calling thread is listed first in the trace
+//-----------------------------------------------------------------------------
+void CTraceRecorder::Start()
+{
+	GetTraceThread();
+
+	{
+		std::lock_guard<std::mutex> lock(s_threadsMutex);
+
+		for (const std::unique_ptr<TraceThread_t>& thread : s_threads)
+		{
+			std::lock_guard<std::mutex> threadLock(thread->mutex);
+			thread->spans.clear();
+		}
+	}
+
+	s_nTraceStartNs = CScopeTimer::GetTime();
+	g_bTraceEnabled.store(true, std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: stops recording and writes the trace
+// Input  : &filePath -
+// Output : true on success, false otherwise
+//-----------------------------------------------------------------------------
+bool CTraceRecorder::Stop(const std::string& filePath)
+{
+	g_bTraceEnabled.store(false, std::memory_order_relaxed);
+
+	std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+
+	std::lock_guard<std::mutex> lock(s_threadsMutex);
+
+	for (const std::unique_ptr<TraceThread_t>& thread : s_threads)
+	{
+		std::lock_guard<std::mutex> threadLock(thread->mutex);
+
+		if (thread->spans.empty() && thread->id != 0)
+			continue;
+
+		json += Format("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s %zu\"}}",
+			first ? "" : ",\n", thread->id, thread->id ? "thread" : "main", thread->id);
+		first = false;
+
+		for (const TraceSpan_t& span : thread->spans)
+		{
+			// spans that started before the trace are cut off at its start
+			const int64_t nStartNs = std::max(span.nStartNs, s_nTraceStartNs);
+
+			json += ",\n{\"name\":";
+			AppendJsonString(json, span.pszName);
+			json += Format(",\"cat\":\"bspconv\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f",
+				thread->id, (nStartNs - s_nTraceStartNs) / 1000.0, (span.nEndNs - nStartNs) / 1000.0);
+
+			if (!span.detail.empty())
+			{
+				json += ",\"args\":{\"detail\":";
+				AppendJsonString(json, span.detail);
+				json += '}';
+			}
+
+			json += '}';
+		}
+
+		thread->spans.clear();
+	}
+
+	json += "\n]}\n";
+
+	CNativeFile out;
+	if (!out.Open(filePath, CNativeFile::WRITE) || !out.Write(json.data(), json.size()))
+	{
+		printf("Failed to write trace file \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	printf("Wrote trace to \"%s\"\n", filePath.c_str());
+	return true;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+// Purpose: collects the spans of CScopeTimer (TIME_SCOPE) into a trace
+//
+// Every thread records into its own buffer, so recording doesn't contend
+// between threads. The trace is written in the Chrome trace event format; open
+// it in chrome://tracing or https://ui.perfetto.dev.
+//-----------------------------------------------------------------------------
+class CTraceRecorder
+{
+public:
+	static void Start();
+	// stops recording and writes out everything recorded since Start
+	static bool Stop(const std::string& filePath);
+};
@@ -6,6 +6,8 @@
 #include <filesystem>
 #include <iostream>
 #include <chrono>
+#include <atomic>
+#include <stdexcept>
 
 #define FILE_EXISTS(path) std::filesystem::exists(path)
 
@@ -21,11 +23,60 @@
 #define ALIGN64( a ) a = (byte *)((__int64)((byte *)a + 63) & ~ 63)
 #define ALIGN512( a ) a = (byte *)((__int64)((byte *)a + 511) & ~ 511)
 
+// when set, Msg() output from the owning thread is appended to this buffer
+// instead of stdout; parallel batch jobs use it to keep their output together
+inline thread_local std::string* g_pThreadMsgBuffer = nullptr;
+
+// redirects Msg() output of the current thread to pBuffer (stdout if nullptr)
+// for its lifetime, restoring the previous target afterwards so tasks executed
+// while their caller waits don't steal its output
+class CScopedMsgBuffer
+{
+public:
+	CScopedMsgBuffer(std::string* const pBuffer) : m_pPrevBuffer(g_pThreadMsgBuffer) { g_pThreadMsgBuffer = pBuffer; }
+	~CScopedMsgBuffer() { g_pThreadMsgBuffer = m_pPrevBuffer; }
+
+private:
+	std::string* m_pPrevBuffer;
+};
+
+static void Msg(const char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+
+	if (g_pThreadMsgBuffer)
+	{
+		va_list argsCopy;
+		va_copy(argsCopy, args);
+		const int len = vsnprintf(nullptr, 0, fmt, argsCopy);
+		va_end(argsCopy);
+
+		if (len > 0)
+		{
+			const size_t oldSize = g_pThreadMsgBuffer->size();
+			g_pThreadMsgBuffer->resize(oldSize + len);
+			vsnprintf(&(*g_pThreadMsgBuffer)[oldSize], len + 1, fmt, args);
+		}
+	}
+	else
+		vprintf(fmt, args);
+
+	va_end(args);
+}
+
 static void Error(const char* fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
 
+	// flush whatever the job had buffered so the error has its context
+	if (g_pThreadMsgBuffer)
+	{
+		fputs(g_pThreadMsgBuffer->c_str(), stdout);
+		g_pThreadMsgBuffer->clear();
+	}
+
 	std::string msg = "ERROR: " + std::string(fmt);
 
 	vprintf(msg.c_str(), args);
@@ -35,6 +86,35 @@ static void Error(const char* fmt, ...)
 	exit(EXIT_FAILURE);
 }
 
+// thrown by ConvertError, ProcessSingleBsp reports it and fails the map
+class CConvertError : public std::runtime_error
+{
+public:
+	CConvertError(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+// fails the map being converted; unlike Error this doesn't end the process, so
+// in batch mode the other maps carry on and the map's outputs are discarded
+[[noreturn]] static void ConvertError(const char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+
+	va_list argsCopy;
+	va_copy(argsCopy, args);
+	const int len = vsnprintf(nullptr, 0, fmt, argsCopy);
+	va_end(argsCopy);
+
+	std::string msg(len > 0 ? size_t(len) : 0, '\0');
+
+	if (len > 0)
+		vsnprintf(&msg[0], len + 1, fmt, args);
+
+	va_end(args);
+
+	throw CConvertError(msg);
+}
+
 static uintmax_t GetFileSize(const std::string& filename)
 {
 	try {
@@ -69,11 +149,11 @@ static std::uint64_t __fastcall HashString(const char* pData)
 	int                   v8; // edx
 	int                   v9; // eax
 	std::uint32_t        v10; // er8
-	int                  v12; // ecx
+	unsigned long        v12; // ecx
 	std::uint32_t* a1 = (std::uint32_t*)pData;
 
 	v1 = a1;
-	v2 = 0i64;
+	v2 = 0LL;
 	v3 = 0;
 	v4 = (*a1 - 45 * ((~(*a1 ^ 0x5C5C5C5Cu) >> 7) & (((*a1 ^ 0x5C5C5C5Cu) - 0x1010101) >> 7) & 0x1010101)) & 0xDFDFDFDF;
 	for (i = ~*a1 & (*a1 - 0x1010101) & 0x80808080; !i; i = v8 & 0x80808080)
@@ -82,42 +162,76 @@ static std::uint64_t __fastcall HashString(const char* pData)
 		v7 = v1[1];
 		++v1;
 		v3 += 4;
-		v2 = ((((std::uint64_t)(0xFB8C4D96501i64 * v6) >> 24) + 0x633D5F1 * v2) >> 61) ^ (((std::uint64_t)(0xFB8C4D96501i64 * v6) >> 24)
+		v2 = ((((std::uint64_t)(0xFB8C4D96501LL * v6) >> 24) + 0x633D5F1 * v2) >> 61) ^ (((std::uint64_t)(0xFB8C4D96501LL * v6) >> 24)
 			+ 0x633D5F1 * v2);
 		v8 = ~v7 & (v7 - 0x1010101);
 		v4 = (v7 - 45 * ((~(v7 ^ 0x5C5C5C5Cu) >> 7) & (((v7 ^ 0x5C5C5C5Cu) - 0x1010101) >> 7) & 0x1010101)) & 0xDFDFDFDF;
 	}
 	v9 = -1;
 	v10 = (i & -(signed)i) - 1;
-	if (_BitScanReverse((unsigned long*)&v12, v10))
+	if (_BitScanReverse(&v12, v10))
 	{
-		v9 = v12;
+		v9 = int(v12);
 	}
-	return 0x633D5F1 * v2 + ((0xFB8C4D96501i64 * (std::uint64_t)(v4 & v10)) >> 24) - 0xAE502812AA7333i64 * (std::uint32_t)(v3 + v9 / 8);
+	return 0x633D5F1 * v2 + ((0xFB8C4D96501LL * (std::uint64_t)(v4 & v10)) >> 24) - 0xAE502812AA7333LL * (std::uint32_t)(v3 + v9 / 8);
 }
 
 using namespace std::chrono;
 
+// set while a trace is being recorded, see CTraceRecorder
+inline std::atomic<bool> g_bTraceEnabled(false);
+
+void TraceRecordSpan(const char* const pszName, const std::string* const pDetail, const int64_t nStartNs, const int64_t nEndNs);
+
+// set while heap allocations are being counted, see CAllocProfiler
+inline std::atomic<bool> g_bAllocProfileEnabled(false);
+
+void AllocProfileEnterPhase(const char* const pszName, const bool isLump);
+void AllocProfileLeavePhase();
+
+//-----------------------------------------------------------------------------
+// Purpose: records the time spent in its scope as a span of the trace; scopes
+//			inside it show up nested under it. it is also a phase of the
+//			allocation profile. when neither is recorded it costs two flag
+//			checks
+//-----------------------------------------------------------------------------
 class CScopeTimer
 {
 public:
-	CScopeTimer(const std::string& name)
+	// pszName has to be a literal, pDetail has to outlive the timer
+	CScopeTimer(const char* const pszName, const std::string* const pDetail = nullptr)
+		: m_pszName(pszName), m_pDetail(pDetail)
 	{
-		m_name = name;
-		m_startTime = system_clock::now().time_since_epoch();
+		m_nStartNs = g_bTraceEnabled.load(std::memory_order_relaxed) ? GetTime() : -1;
+		m_bProfiled = g_bAllocProfileEnabled.load(std::memory_order_relaxed);
+
+		if (m_bProfiled)
+			AllocProfileEnterPhase(pszName, false);
 	}
 
 	~CScopeTimer()
 	{
-		system_clock::duration now = system_clock::now().time_since_epoch();
-		printf("%s: finished in %.3fms\n", m_name.c_str(), duration_cast<microseconds>(now - m_startTime).count() / 1000.f);
+		if (m_bProfiled)
+			AllocProfileLeavePhase();
+
+		if (m_nStartNs >= 0)
+			TraceRecordSpan(m_pszName, m_pDetail, m_nStartNs, GetTime());
 	}
 
+	// monotonic, in nanoseconds
+	static inline int64_t GetTime() { return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count(); }
+
 private:
-	std::string m_name;
-	system_clock::duration m_startTime;
+	const char* m_pszName;
+	const std::string* m_pDetail;
+	int64_t m_nStartNs;
+	bool m_bProfiled;
 };
 
 #define XTIME_SCOPE2(x, y) CScopeTimer __timer_##y(x)
 #define XTIME_SCOPE(x, y) XTIME_SCOPE2(x, y)
 #define TIME_SCOPE(x) XTIME_SCOPE(x, __COUNTER__)
+
+#define XTIME_SCOPE_DETAIL2(x, d, y) CScopeTimer __timer_##y(x, &(d))
+#define XTIME_SCOPE_DETAIL(x, d, y) XTIME_SCOPE_DETAIL2(x, d, y)
+#define TIME_SCOPE_DETAIL(x, d) XTIME_SCOPE_DETAIL(x, d, __COUNTER__)
@@ -1,5 +1,33 @@
 #pragma once
 #include "rmem.h"
 
-void ConvertLightProbes_v51(rmem& lumpbuf, char*& lumpData, size_t& lumpSize);
-void ConvertBSP(const std::string& bspPath, char* const bspBuf, const bool packAllLumps);
+class CArena;
+class COutputSet;
+class CLumpInventory;
+struct MapStats_t;
+
+void ExpandLightProbes_v51(const char* const src, char* const dst, const size_t numLightProbes);
+void ConvertLightProbes_v51(rmem& lumpbuf, char*& lumpData, size_t& lumpSize, CArena& arena);
+// the lump is opened relative to the map's directory if pInventory has listed it
+bool GetEntityPartitionNames(const std::string& bspPath, std::vector<std::string>& vec, const CLumpInventory* const pInventory = nullptr);
+
+// options for ConvertBSP
+struct ConvertOptions_t
+{
+	ConvertOptions_t() : packAllLumps(false), parallelWrite(false), asyncIO(false), prefetchWindow(0), hugePages(false), memoryCap(0), bufferPartitions(false) {}
+
+	bool packAllLumps;
+	bool parallelWrite; // packed bsp is preallocated and lumps are written concurrently at precomputed offsets
+	bool asyncIO; // lump file metadata and opens are batched through io_uring where available
+	size_t prefetchWindow; // number of lumps ahead of the pipeline to issue readahead for, 0 to disable
+	bool hugePages; // the per-map lump memory is backed by huge/large pages where available
+	size_t memoryCap; // bytes, packing streams transformed lumps in pieces to stay below it, 0 to disable
+	bool bufferPartitions; // entity partitions are converted as a whole by CEntityPartitionMgr instead of streamed, the reference for the streaming converter
+};
+
+// every file written is recorded in outputs, see COutputSet; what the
+// conversion did is recorded in pStats if set. Throws CConvertError if the map
+// can't be converted, the caller discards outputs then
+// pInventory is the map's directory listing if the caller has one already
+void ConvertBSP(const std::string& bspPath, char* const bspBuf, const ConvertOptions_t& options, COutputSet& outputs, MapStats_t* const pStats = nullptr, const CLumpInventory* const pInventory = nullptr);
+size_t EstimateConvertMemory(const char* const bspBuf, const ConvertOptions_t& options);
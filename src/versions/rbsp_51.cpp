@@ -1,32 +1,112 @@
 #include "stdafx.h"
 #include "versions.h"
 #include "rmem.h"
+#include "arena.h"
 #include "bspfile.h"
+#include "cpufeatures.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(r5::v51::dlightprobe_t) == 44 && sizeof(dlightprobe_t) == 48,
+	"lightprobe expansion kernels assume 44 byte source and 48 byte destination records");
+
+// scalar reference: copy each 44 byte probe and zero the 4 byte pad
+[[maybe_unused]] static void ExpandLightProbes_Scalar(const char* src, char* dst, const size_t numLightProbes)
+{
+	for (size_t j = 0; j < numLightProbes; ++j)
+	{
+		memcpy(dst, src, sizeof(r5::v51::dlightprobe_t));
+		memset(dst + sizeof(r5::v51::dlightprobe_t), 0, sizeof(dlightprobe_t) - sizeof(r5::v51::dlightprobe_t));
+
+		src += sizeof(r5::v51::dlightprobe_t);
+		dst += sizeof(dlightprobe_t);
+	}
+}
+
+#ifdef CPU_X86
+// bytes 0-31 are copied as is, bytes 32-43 come from an overlapping load at 28
+// shifted down by 4, which shifts in the zeroed pad; never reads past the probe
+static void ExpandLightProbes_SSE2(const char* src, char* dst, const size_t numLightProbes)
+{
+	for (size_t j = 0; j < numLightProbes; ++j)
+	{
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+		const __m128i c = _mm_srli_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 28)), 4);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), a);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), b);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), c);
+
+		src += sizeof(r5::v51::dlightprobe_t);
+		dst += sizeof(dlightprobe_t);
+	}
+}
+
+// two probes (88 bytes) per iteration become three 32 byte stores; the loads at
+// 28 and 56 are shuffled down by one dword and the pads blended in, so nothing
+// past the pair is read. an odd probe at the end goes through the SSE2 kernel
+TARGET_AVX2 static void ExpandLightProbes_AVX2(const char* src, char* dst, const size_t numLightProbes)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i shiftMid = _mm256_setr_epi32(1, 2, 3, 0, 4, 5, 6, 7); // [s32 s36 s40 pad s44 s48 s52 s56]
+	const __m256i shiftEnd = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0); // [s60 ... s84 pad]
+
+	size_t j = 0;
+
+	for (; j + 2 <= numLightProbes; j += 2)
+	{
+		const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+		const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 28));
+		const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 56));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), a);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32), _mm256_blend_epi32(_mm256_permutevar8x32_epi32(b, shiftMid), zero, 0x08));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 64), _mm256_blend_epi32(_mm256_permutevar8x32_epi32(c, shiftEnd), zero, 0x80));
+
+		src += 2 * sizeof(r5::v51::dlightprobe_t);
+		dst += 2 * sizeof(dlightprobe_t);
+	}
+
+	if (j < numLightProbes)
+		ExpandLightProbes_SSE2(src, dst, numLightProbes - j);
+}
+#endif
+
+// widens numLightProbes v51 probes from src into v47 probes at dst using the
+// widest kernel the cpu supports, all kernels produce identical output
+void ExpandLightProbes_v51(const char* const src, char* const dst, const size_t numLightProbes)
+{
+#ifdef CPU_X86
+	if (CPU_HasAVX2())
+		ExpandLightProbes_AVX2(src, dst, numLightProbes);
+	else if (CPU_IsSIMDEnabled())
+		ExpandLightProbes_SSE2(src, dst, numLightProbes);
+	else
+		ExpandLightProbes_Scalar(src, dst, numLightProbes);
+#else
+	ExpandLightProbes_Scalar(src, dst, numLightProbes);
+#endif
+}
 
 // convert v51 lightprobes to v47
 // lightprobe struct got smaller by 4 bytes in version 51 by removing the "pad" variable
 // that was used to align the struct to 16 bytes to use SIMD operations for optimisation
 // this function appends the bytes back to the struct to make it 16 bytes again
-void ConvertLightProbes_v51(rmem& lumpbuf, char*& lumpData, size_t& lumpSize)
+//
+// lumpData is replaced with a buffer allocated from the map's arena, the
+// source buffer is left untouched so it may point into a file view
+void ConvertLightProbes_v51(rmem& lumpbuf, char*& lumpData, size_t& lumpSize, CArena& arena)
 {
 	const size_t numLightProbes = lumpSize / (sizeof(r5::v51::dlightprobe_t));
 	const size_t newLumpSize = numLightProbes * sizeof(dlightprobe_t);
 
 	// allocate buffer for the converted lump data
-	char* const newLumpData = new char[newLumpSize];
-	rmem newLumpBuf(newLumpData);
-
-	const r5::v51::dlightprobe_t* const lightProbes = reinterpret_cast<r5::v51::dlightprobe_t*>(lumpbuf.getPtr());
-
-	for (size_t j = 0; j < numLightProbes; ++j)
-	{
-		lumpbuf.seek(j * sizeof(r5::v51::dlightprobe_t), rseekdir::beg);
-
-		newLumpBuf.write<r5::v51::dlightprobe_t>(lightProbes[j]);
-		newLumpBuf.write<int>(0);
-	}
+	char* const newLumpData = arena.Alloc<char>(newLumpSize);
 
-	delete[] lumpData;
+	ExpandLightProbes_v51(reinterpret_cast<const char*>(lumpbuf.getPtr()), newLumpData, numLightProbes);
 
 	lumpData = newLumpData;
 	lumpSize = newLumpSize;